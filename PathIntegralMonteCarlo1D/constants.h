@@ -34,6 +34,25 @@ double lambda;
 double dtau;
 int PIGS;
 double alpha;
+
+/*
+sigma_wf and mu_wf are the parameters of the variational wave function projected
+by PIGS. Its logarithm and its kinetic local energy at the two ends of the polymer
+are cached in the following variables: they change only when an end bead moves.
+*/
+const double sigma_wf = 0.62;
+const double mu_wf = 0.80;
+double log_psi_left, log_psi_right;
+double local_energy_left, local_energy_right;
+
+/*
+With trial_wavefunction = 1 the trial wave function is instead the ground state of the
+hamiltonian, found by exact diagonalization on trial_points points in [-trial_extent, trial_extent]:
+trial_log_psi holds its logarithm on the grid and trial_energy its energy.
+*/
+int trial_wavefunction, trial_points;
+double trial_extent, trial_energy;
+double* trial_log_psi;
 /*
 The following declarations are the variables used by QMC1D. Don't worry, they
 are self explaining if you roughly know how a PIMC works.
@@ -41,12 +60,56 @@ are self explaining if you roughly know how a PIMC works.
 
 int timeslices, brownianBridgeReconstructions, brownianBridgeAttempts, brownianMotionReconstructions;
 int MCSTEPS, equilibration, blocks, histogram_bins;
+int completed_blocks;  // blocks accumulated so far, the estimators are averaged over them
+unsigned int seed;
 int timeslices_averages_start, timeslices_averages_end;
 double temperature, imaginaryTimePropagation, delta_variational, delta_translation;
 double histogram_start, histogram_end;
 
-int acceptedTranslations, acceptedVariational, acceptedBB, acceptedBM;
-int totalTranslations, totalVariational, totalBB, totalBM;
+int acceptedTranslations, acceptedVariational, acceptedBB, acceptedBM, acceptedHMC;
+int totalTranslations, totalVariational, totalBB, totalBM, totalHMC;
+
+/*
+Every move draws its random numbers from its own Philox stream (path_steps, path_moves), opened
+by pathStream(): path_steps counts the MC steps (the step 0 is the set up) and path_moves the
+moves of the current step. The key is (seed, 1), while the bridge domains use (seed, 0), so the
+two never share numbers. A run depends only on the seed, not on the number of threads.
+*/
+Philox path_philox;
+long path_steps;
+uint32_t path_moves;
+
+/*
+Hybrid Monte Carlo: hmc_attempts moves per MC step, each one made of hmc_steps leapfrog steps
+of length hmc_stepsize. hmc_normal_modes switches on the free particle mass matrix, whose
+Cholesky factor is stored in the hmc_mass_* arrays.
+*/
+int hmc_attempts, hmc_steps, hmc_normal_modes;
+double hmc_stepsize;
+double* hmc_positions;
+double* hmc_momenta;
+double* hmc_velocities;
+double* hmc_forces;
+double* hmc_mass_diagonal;
+double* hmc_mass_subdiagonal;
+double* hmc_mass_last_row;
+
+/*
+Coarse to fine equilibration: the polymer starts with no less than coarse_timeslices timeslices
+and it is equilibrated for coarse_steps MC steps at every level of resolution.
+*/
+int coarse_timeslices, coarse_steps;
+
+/*
+Matrix squaring pair action: pair_action_table holds U(x,x';dtau) on a grid of pair_action_points
+points in [-pair_action_extent, pair_action_extent]. pair_action_active is set when the moves use it.
+potential_label names external_potential in the files where the tables are saved: change it
+whenever you change the potential!
+*/
+const char* potential_label = "x4-2.5x2";
+int pair_action_points, pair_action_squarings, pair_action_active;
+double pair_action_extent;
+double* pair_action_table;
 
 double* positions;
 double* potential_energy;
@@ -61,6 +124,121 @@ double* positions_histogram;
 double* positions_histogram_accumulator;
 double* positions_histogram_square_accumulator;
 
+/*
+Kernel density estimator: the positions are binned on density_bins bins between histogram_start
+and histogram_end and, at the end of every block, convolved by FFT with a gaussian kernel of width
+density_bandwidth (density_kernel holds its transform).
+*/
+int density_bins, density_fft_size;
+double density_bandwidth;
+double* density_histogram;
+double* density_accumulator;
+double* density_square_accumulator;
+std::complex<double>* density_kernel;
+std::complex<double>* density_fft_buffer;
+
+/*
+The estimators of the current configuration are kept in potential_current, kinetic_current
+and histogram_bin, and they are re-evaluated only for the beads moved by an accepted move.
+A value is added to the block averages, weighted by the number of measurements during which it
+held, only when it changes or at the end of the block: last_measurement stores, for each
+timeslice, the value of "measurements" at that time. Measurements are taken every
+measurement_interval MC steps.
+*/
+int measurement_interval, measurements;
+double* potential_current;
+double* kinetic_current;
+int* histogram_bin;
+int* density_bin;
+int* last_measurement;
+
+/*
+In pipeline mode (pipeline_threads > 0) the sampler does not measure: every measurement it
+publishes a snapshot of the polymer in the ring buffer of one of the workers (round robin).
+Each ring has pipeline_slots preallocated snapshots of timeslices+2 values (the positions and
+the local energies at the two ends). head is advanced only by the sampler and tail only by
+the worker, so the rings need no lock while data flows. A side that finds the ring full, empty
+or not yet drained sleeps on the condition variable "changed": waiting counts the sleepers, so
+that the other side takes the mutex to wake them only when somebody sleeps. Every worker
+accumulates its own block averages, that are summed at the end of the block.
+*/
+struct pipelineWorker
+{
+	double* slots;
+	std::atomic<long> head;
+	std::atomic<long> tail;
+	double* potential_energy;
+	double* kinetic_energy;
+	double* positions_histogram;
+	double* density_histogram;
+	double* correlation;
+	std::complex<double>* fft_buffer;
+	int measurements;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::atomic<int> waiting;
+};
+int pipeline_threads, pipeline_slots, pipeline_next;
+pipelineWorker* pipeline;
+std::atomic<bool> pipeline_stop;
+
+/*
+Parallel bridge (bridge_threads > 0): the polymer is split in domains of bridge_domain_length
+links, whose first bead and number of links are stored in bridge_domain_start and
+bridge_domain_links. The domains of a sweep are handed out through bridge_next_domain to a pool
+of bridge_threads threads (the main thread included): the others sleep on bridge_start until
+bridge_generation changes, and the main thread sleeps on bridge_done until all of them are idle
+again (bridge_generation, bridge_idle_threads and bridge_stop are guarded by bridge_mutex).
+The random numbers of a domain are drawn from the Philox stream (bridge_sweeps, domain), so
+they do not depend on the thread that moves it: the result is the same for any bridge_threads.
+*/
+int bridge_threads, bridge_domain_length, bridge_domains;
+int* bridge_domain_start;
+int* bridge_domain_links;
+int* bridge_domain_accepted;
+int* bridge_domain_total;
+Philox bridge_philox;
+long bridge_sweeps;
+std::thread* bridge_pool;
+std::atomic<int> bridge_next_domain;
+int bridge_generation, bridge_idle_threads;
+bool bridge_stop;
+std::mutex bridge_mutex;
+std::condition_variable bridge_start, bridge_done;
+
+/*
+Trajectory (trajectory_stride > 0): every trajectory_stride MC steps of the blocks the polymer is
+stored in trajectory.bin, as float32 (trajectory_encoding = 0) or as the first bead quantized in
+units of trajectory_quantum (int32) followed by the differences between adjacent quantized
+beads (int16, trajectory_encoding = 1). The frames are encoded by the sampler in one of the two
+buffers of trajectory_buffer_frames frames, while the writer thread writes the other one: the
+sampler waits only if the writer has not finished the previous buffer yet.
+*/
+int trajectory_stride, trajectory_encoding, trajectory_frame_size;
+double trajectory_quantum;
+long trajectory_steps, trajectory_frames;
+const int trajectory_buffer_frames = 256;
+char* trajectory_buffer[2];
+int trajectory_current, trajectory_fill;
+int trajectory_pending;  // frames handed to the writer, 0 when it is idle
+std::ofstream trajectory_file;
+std::thread trajectory_writer;
+std::mutex trajectory_mutex;
+std::condition_variable trajectory_signal;
+bool trajectory_stop;
+
+/*
+The imaginary-time correlation function <x(0)x(tau)> is evaluated by FFT on each
+measurement. correlation_lags is the number of tau values that are written out,
+correlation_fft_size the (power of two) length of the zero-padded transform.
+*/
+int correlation_function, correlation_lags, correlation_fft_size;
+double* correlation;
+double* correlation_accumulator;
+double* correlation_square_accumulator;
+std::complex<double>* correlation_fft_buffer;
+
 /****************************************************************
 *****************************************************************
     _/    _/  _/_/_/  _/       Numerical Simulation Laboratory
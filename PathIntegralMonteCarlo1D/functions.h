@@ -9,16 +9,19 @@ _/    _/  _/_/_/  _/_/_/_/ email: Davide.Galli@unimi.it
 *****************************************************************/
 
 /*
-The comments in this file are not detailed. See qmc1d.cpp for a better explanation.
+The comments in this file are not detailed. See qmc1d_lib.cpp for a better explanation.
 */
 
-void readInput();   // reads input from the file "input.dat"
+void setParameters(const qmc1d_params*);   // copies the parameters of the simulation in the global variables
 void deleteMemory(); // handles the dynamic allocation of memory
 void initialize();  // initializes the variables
 void consoleOutput(); // writes the output on the screen
+double acceptance(int, int); // (accepted, total) moves, 0 if no move was attempted
                                                                                                                  
                                                                                                                  
 double potential_density_matrix(double val, double val_next);
+void setupPairAction(); // computes (or reads) the matrix squaring table
+double pairAction(double, double); // interpolates U(x,x';dtau) from the table
 double u_prime(double x, int m);
 double u_sec(double x, int m);
 
@@ -37,14 +40,37 @@ the laplacian operator !
                                                                                                                  
 void translation(); // performs a rigid translation
 void brownianBridge();  // reconstructs a segment of the polymer with a free particle propagation. 
+template<class Generator> int bridgeSegment(int, int, Generator&); // BB of (starting point, reconstructions) with a given generator
+void parallelBridge(); // BB moves on independent domains of the polymer, on several threads
+void updateDomains(); // the calling thread updates domains until none is left
+void bridgeWork(); // the loop of a thread of the parallel bridge
 void brownianMotion(int);  // reconstructs a segment at the extremities of the polymer with a free particle propagation. 
+void hybridMonteCarlo(); // moves the whole polymer with a leapfrog trajectory of fictitious dynamics
+double polymerAction(const double*); // the action of a polymer configuration
+void polymerForce(const double*, double*); // minus the gradient of the (primitive) action
+void setupHybridMonteCarlo(); // the Cholesky factor of the HMC mass matrix
+void massInverse(const double*, double*); // solves M v = p
+void monteCarloStep(); // performs all the moves of a MC step
+PhiloxStream pathStream(); // the random numbers of the next move of the current MC step
+void benchmark(); // measures the statistical efficiency of the settings in "benchmark.dat"
+double integratedAutocorrelation(const double*, int, double&); // (series, length, variance)
+void resetPolymer(); // brings the polymer back to its initial configuration
+void coarseEquilibration(); // equilibrates the polymer doubling the number of timeslices up to the target one
+void doubleTimeslices(); // inserts a free particle midpoint between adjacent beads
                                                                                                                  
 double variationalWaveFunction(double);  
 /*variationalWaveFunction is the variational wave function that is
 projected in a PIGS simulation.
 */
+double logVariationalWaveFunction(double); // its logarithm, used by the moves
+double logVariationalWaveFunction_prime(double); // and the derivative of the logarithm, used by HMC
 double variationalWaveFunction_second(double);
 double variationalLocalEnergy(double val);
+void updateTrialCache(int); // re-evaluates log psi and the local energy at the LEFT or RIGHT end
+void exactDiagonalization(); // Lanczos ground state of the hamiltonian, tabulated as trial wave function
+double tridiagonalEigenvalue(const double*, const double*, int, int); // (diagonal, off diagonal, size, index)
+void tridiagonalEigenvector(const double*, const double*, int, double, double*); // (..., eigenvalue, eigenvector)
+double tabulatedLogWaveFunction(double, int); // log psi (or its derivative) of the tabulated trial function
 /*
 as for the potential, you have to specify its first and second derivative for the evaluation
 of the kinetic local energy.
@@ -55,15 +81,42 @@ int index_mask(int);
 polymer is open (PIGS) or closed in periodic boundary contitions (PIMC-ring polymer).
 */
 
-void upgradeAverages(); // at every MCSTEP accumulates the estimators values.
+void upgradeAverages(); // every measurement_interval MCSTEPS accumulates the estimators values.
 
-void upgradeHistogram(); // fills the histogram of positions foreach MCSTEP
+void beadsChanged(int, int); // updates the estimators after an accepted move of (first bead, number of beads)
+void flushTimeslice(int); // adds the current estimators of a timeslice to the block averages
+void updateTimeslice(int); // re-evaluates the current estimators of a timeslice
+double kineticTimeslice(int); // the kinetic estimator of a timeslice, from the current positions
+int histogramBin(double); // the bin of the histogram of positions containing a position
+int densityBin(double); // the bin of the fine grid of the density estimator
+void endBlockDensity(); // smooths the positions of the block with the gaussian kernel
+void setupDensityKernel(); // the transform of the gaussian kernel
+void upgradeCorrelation(); // accumulates <x(0)x(tau)> along the polymer foreach MCSTEP
+void correlationEstimator(const double*, double*, std::complex<double>*); // (positions, accumulator, FFT workspace)
+void fft(std::complex<double>*, int, int); // in-place radix-2 FFT, the last argument is the sign of the exponent
 void endBlock(); // finalizes the averages at the end of each block
 
+void startPipeline(); // allocates the ring buffers and starts the worker threads
+void publishSnapshot(); // the sampler copies the polymer in the next ring buffer
+void pipelineWork(int); // the loop of a worker thread
+void measureSnapshot(const double*, pipelineWorker&); // evaluates every estimator on a snapshot
+void pipelineNotify(pipelineWorker&); // wakes the thread sleeping on a ring, if any
+void collectPipeline(); // waits for the workers and sums their block averages
+void stopPipeline(); // joins the worker threads
+
+bool startTrajectory(); // opens trajectory.bin, writes its header and starts the writer thread, false if it can't be opened
+void recordTrajectory(); // encodes the polymer in the current buffer
+void flushTrajectory(); // hands the current buffer to the writer thread
+void trajectoryWork(); // the loop of the writer thread
+void stopTrajectory(); // writes the last frames and the number of frames, joins the writer
+
 double kineticEstimator(double,double);  // evaluates the kinetic energy along the polymer
+void blockAverage(const double*, const double*, int, double*, double*); // averages and errors over the completed blocks
 void finalizePotentialEstimator();
 void finalizeKineticEstimator();
 void finalizeHistogram();
+void finalizeDensity();
+void finalizeCorrelation();
 /*
 The last three functions are called at the end of the simulation, basically they average over each
 block and evaluate the error on the block average. This is an application of the central limit
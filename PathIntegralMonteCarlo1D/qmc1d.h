@@ -0,0 +1,116 @@
+/****************************************************************
+*****************************************************************
+    _/    _/  _/_/_/  _/       Numerical Simulation Laboratory
+   _/_/  _/ _/       _/       Physics Department
+  _/  _/_/    _/    _/       Universita' degli Studi di Milano
+ _/    _/       _/ _/       Prof. D.E. Galli
+_/    _/  _/_/_/  _/_/_/_/ email: Davide.Galli@unimi.it
+*****************************************************************
+*****************************************************************/
+
+/*
+This is the interface of the QMC1D library (libqmc1d.so). It exposes the engine to C and C++
+programs (and to python through ctypes): the simulation is set up from a qmc1d_params struct,
+the blocks are run on demand and the estimators are copied in buffers provided by the caller,
+so that many simulations can be run in one process without reading or writing any file.
+The engine keeps its state in global variables, as the qmc1d program always did: only one
+simulation at a time can be alive in a process, and a new qmc1d_init() must follow qmc1d_free().
+A typical driver:
+
+	qmc1d_params params;
+	qmc1d_read_params("input.dat", &params);   // or fill the struct by hand
+	params.temperature = 0.5;
+	qmc1d_init(&params);
+	qmc1d_equilibrate();
+	qmc1d_run_blocks(params.blocks);
+	double* average = new double[qmc1d_timeslices()];
+	double* error = new double[qmc1d_timeslices()];
+	qmc1d_potential(average, error);
+	qmc1d_free();
+*/
+#ifndef QMC1D_H
+#define QMC1D_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+libqmc1d.so is built with -fvisibility=hidden: only the functions marked QMC1D_API are exported,
+so the globals and the helpers of the engine can't clash with the symbols of the host program.
+*/
+#if defined(__GNUC__)
+#define QMC1D_API __attribute__((visibility("default")))
+#else
+#define QMC1D_API
+#endif
+
+/*
+The parameters have the names and the meaning of the lines of "input.dat".
+seed initializes the random number generator (4357 is the default seed of TRandom3).
+*/
+typedef struct
+{
+	int timeslices;
+	double temperature;
+	double imaginaryTimePropagation;
+	int brownianMotionReconstructions;
+	double delta_translation;
+	int brownianBridgeReconstructions;
+	int brownianBridgeAttempts;
+	int MCSTEPS;
+	int equilibration;
+	int blocks;
+	int measurement_interval;
+	int histogram_bins;
+	double histogram_start, histogram_end;
+	int density_bins;
+	double density_bandwidth;
+	int timeslices_averages_start, timeslices_averages_end;
+	int correlation_function;
+	int pipeline_threads, pipeline_slots;
+	int bridge_threads, bridge_domain_length;
+	int hmc_attempts, hmc_steps;
+	double hmc_stepsize;
+	int hmc_normal_modes;
+	int coarse_timeslices, coarse_steps;
+	int pair_action_points;
+	double pair_action_extent;
+	int pair_action_squarings;
+	int trial_wavefunction, trial_points;
+	double trial_extent;
+	int trajectory_stride, trajectory_encoding;
+	double trajectory_quantum;
+	unsigned int seed;
+} qmc1d_params;
+
+QMC1D_API int qmc1d_read_params(const char* filename, qmc1d_params* params); // reads an input file, returns 0 if it can't be opened, a line is missing or malformed, or measurement_interval is not in [1,MCSTEPS]
+QMC1D_API int qmc1d_init(const qmc1d_params* params); // allocates and initializes the simulation, returns 0 if trajectory.bin can't be opened (qmc1d_free() is still needed)
+QMC1D_API void qmc1d_equilibrate(void); // runs the (coarse and) equilibration steps
+QMC1D_API void qmc1d_run_blocks(int number); // runs and accumulates number blocks of MCSTEPS steps
+QMC1D_API void qmc1d_free(void); // de-allocates the simulation
+
+QMC1D_API int qmc1d_completed_blocks(void);
+QMC1D_API int qmc1d_timeslices(void);  // length of the potential and kinetic arrays
+QMC1D_API int qmc1d_correlation_lags(void);  // length of the correlation arrays
+
+/*
+Averages and errors over the completed blocks, written in arrays of the lengths above
+(histogram_bins and density_bins for the histogram and the density). position and tau
+receive the centres of the bins and the imaginary times; they may be NULL.
+*/
+QMC1D_API void qmc1d_potential(double* average, double* error);
+QMC1D_API void qmc1d_kinetic(double* average, double* error);
+QMC1D_API void qmc1d_histogram(double* position, double* average, double* error);
+QMC1D_API void qmc1d_density(double* position, double* average, double* error);
+QMC1D_API void qmc1d_correlation(double* tau, double* average, double* error);
+QMC1D_API void qmc1d_acceptances(double* translation, double* bridge, double* motion, double* hmc);
+
+QMC1D_API void qmc1d_write_output(void); // writes the acceptances on the screen and the estimators in the .dat files
+QMC1D_API void qmc1d_benchmark(void); // the "./qmc1d benchmark" mode, see benchmark()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,2460 @@
+/****************************************************************
+*****************************************************************
+    _/    _/  _/_/_/  _/       Numerical Simulation Laboratory
+   _/_/  _/ _/       _/       Physics Department
+  _/  _/_/    _/    _/       Universita' degli Studi di Milano
+ _/    _/       _/ _/       Prof. D.E. Galli
+_/    _/  _/_/_/  _/_/_/_/ email: Davide.Galli@unimi.it
+*****************************************************************
+*****************************************************************/
+
+/*********************** QMC1D **************************
+************** PATH INTEGRAL GROUND STATE ***************
+************** PATH INTEGRAL MONTE CARLO ****************
+************ APPLIED TO A SINGLE PARTICLE ***************
+************** IN AN EXTERNAL POTENTIAL ****************/
+/*
+NOTE: you need the root package to be installed before compiling this program.
+See: http://root.cern.ch
+This is the engine of QMC1D, built as the library libqmc1d.so: its interface is declared in
+qmc1d.h, and qmc1d.cpp is the command line program "./qmc1d" built on top of it.
+There are two other source files, too:
+constants.h: contains the declaration of every global variable that has been used.
+functions.h: contains the declaration of the function with a brief description.
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <complex>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include "philox.h"
+#include "qmc1d.h"
+#include "constants.h"
+#include "functions.h"
+
+#define LEFT 0
+#define RIGHT 1
+
+using namespace std;
+
+/*
+Every line of the input file is "label values...": the label must be the expected one and all the
+values must be read, otherwise the file is rejected. An input file written for an older version of
+the program (without some of the lines) is reported instead of being misread.
+*/
+bool inputValues(istream&)
+{
+	return true;
+}
+
+template<typename T, typename... Rest> bool inputValues(istream& input_file, T& value, Rest&... rest)
+{
+	return (input_file >> value) && inputValues(input_file, rest...);
+}
+
+template<typename... T> bool inputLine(istream& input_file, const char* label, T&... values)
+{
+	string read_label;
+	if(!(input_file >> read_label) || read_label!=label)
+	{
+		cerr<<"Input file: the line \""<<label<<"\" is missing";
+		if(!read_label.empty())
+			cerr<<" (found \""<<read_label<<"\")";
+		cerr<<endl;
+		return false;
+	}
+	if(!inputValues(input_file, values...))
+	{
+		cerr<<"Input file: wrong or missing values in the line \""<<label<<"\""<<endl;
+		return false;
+	}
+	return true;
+}
+
+int qmc1d_read_params(const char* filename, qmc1d_params* params)
+{
+	ifstream input_file(filename);
+	if(!input_file)
+		return 0;
+
+	bool good = inputLine(input_file, "timeslices", params->timeslices)
+		&& inputLine(input_file, "temperature", params->temperature)
+		&& inputLine(input_file, "imaginaryTimePropagation", params->imaginaryTimePropagation)
+		&& inputLine(input_file, "brownianMotionReconstructions", params->brownianMotionReconstructions)
+		&& inputLine(input_file, "delta_translation", params->delta_translation)
+		&& inputLine(input_file, "brownianBridgeReconstructions", params->brownianBridgeReconstructions)
+		&& inputLine(input_file, "brownianBridgeAttempts", params->brownianBridgeAttempts)
+		&& inputLine(input_file, "MCSTEPS", params->MCSTEPS)
+		&& inputLine(input_file, "equilibration", params->equilibration)
+		&& inputLine(input_file, "blocks", params->blocks)
+		&& inputLine(input_file, "measurement_interval", params->measurement_interval)
+		&& inputLine(input_file, "histogram_bins", params->histogram_bins)
+		&& inputLine(input_file, "histogram_start", params->histogram_start)
+		&& inputLine(input_file, "histogram_end", params->histogram_end)
+		&& inputLine(input_file, "density_estimator", params->density_bins, params->density_bandwidth)
+		&& inputLine(input_file, "timeslices_interval_for_averages", params->timeslices_averages_start, params->timeslices_averages_end)
+		&& inputLine(input_file, "imaginary_time_correlation", params->correlation_function)
+		&& inputLine(input_file, "estimator_pipeline", params->pipeline_threads, params->pipeline_slots)
+		&& inputLine(input_file, "parallel_bridge", params->bridge_threads, params->bridge_domain_length)
+		&& inputLine(input_file, "hybrid_monte_carlo", params->hmc_attempts, params->hmc_steps, params->hmc_stepsize, params->hmc_normal_modes)
+		&& inputLine(input_file, "coarse_equilibration", params->coarse_timeslices, params->coarse_steps)
+		&& inputLine(input_file, "pair_action", params->pair_action_points, params->pair_action_extent, params->pair_action_squarings)
+		&& inputLine(input_file, "trial_wavefunction", params->trial_wavefunction, params->trial_points, params->trial_extent)
+		&& inputLine(input_file, "trajectory", params->trajectory_stride, params->trajectory_encoding, params->trajectory_quantum);
+	params->seed = 4357;
+	input_file.close();
+	if(!good)
+		return 0;
+	if(params->measurement_interval<1 || params->measurement_interval>params->MCSTEPS)
+	{
+		cerr<<"measurement_interval must be between 1 and MCSTEPS ("<<params->MCSTEPS<<")"<<endl;
+		return 0;
+	}
+	return 1;
+}
+
+int qmc1d_init(const qmc1d_params* params)
+{
+	setParameters(params);
+	initialize();
+/* at this time, every variable you see, such for instance "equilibration",
+has been either acquired from the parameters by the setParameters() function or
+opportunely initialized by the initialize() function. */
+	if(pipeline_threads)
+		startPipeline();
+	if(trajectory_stride && !startTrajectory())
+		return 0;
+	return 1;
+}
+
+void qmc1d_equilibrate()
+{
+	if(coarse_timeslices)
+		coarseEquilibration();
+	
+	for(int i=0;i<equilibration;i++)
+		monteCarloStep();
+}
+
+void qmc1d_run_blocks(int number)
+{
+	for(int b=0;b<number;b++)
+	{
+		for(int i=0;i<MCSTEPS;i++)
+		{
+			monteCarloStep();
+			
+			if(trajectory_stride && (++trajectory_steps)%trajectory_stride==0)
+				recordTrajectory();
+			
+			if((i+1)%measurement_interval==0)
+			{
+				if(pipeline_threads)
+					publishSnapshot();
+				else
+					upgradeAverages();
+			}
+		}
+		if(pipeline_threads)
+			collectPipeline();
+		endBlock();
+	}
+}
+
+void qmc1d_free()
+{
+	if(pipeline_threads)
+		stopPipeline();
+	if(trajectory_stride)
+		stopTrajectory();
+	deleteMemory();  // de-allocate dynamic variables.
+}
+
+int qmc1d_completed_blocks()
+{
+	return completed_blocks;
+}
+
+int qmc1d_timeslices()
+{
+	return timeslices;
+}
+
+int qmc1d_correlation_lags()
+{
+	return correlation_lags;
+}
+
+/*
+The block averages are accumulated together with their squares: the estimate is the average
+over the completed blocks and its error is given by the usual formula err(A)=sqrt(|<A><A>-<A*A>|/Nblocks)
+*/
+void blockAverage(const double* accumulator, const double* square_accumulator, int length, double* average, double* error)
+{
+	for(int i=0;i<length;i++)
+	{
+		double value_average = accumulator[i]/completed_blocks;
+		double value_square_avg = square_accumulator[i]/completed_blocks;
+		if(average)
+			average[i] = value_average;
+		if(error)
+			error[i] = sqrt(abs(value_average*value_average-value_square_avg)/completed_blocks);
+	}
+}
+
+void qmc1d_potential(double* average, double* error)
+{
+	blockAverage(potential_energy_accumulator, potential_energy_square_accumulator, timeslices, average, error);
+}
+
+void qmc1d_kinetic(double* average, double* error)
+{
+	blockAverage(kinetic_energy_accumulator, kinetic_energy_square_accumulator, timeslices, average, error);
+}
+
+// the histogram is normalized to a probability density
+void qmc1d_histogram(double* position, double* average, double* error)
+{
+	double delta_pos = (histogram_end-histogram_start)/histogram_bins;
+	double norma = 0.0;
+	for(int i=0; i<histogram_bins; i++)
+		norma += positions_histogram_accumulator[i]/completed_blocks;
+	norma *= delta_pos;
+	
+	blockAverage(positions_histogram_accumulator, positions_histogram_square_accumulator, histogram_bins, average, error);
+	for(int i=0; i<histogram_bins; i++)
+	{
+		if(position)
+			position[i] = histogram_start + (i+0.5)*delta_pos;
+		if(average)
+			average[i] /= norma;
+		if(error)
+			error[i] /= norma;
+	}
+}
+
+void qmc1d_density(double* position, double* average, double* error)
+{
+	double delta_pos = (histogram_end-histogram_start)/density_bins;
+	blockAverage(density_accumulator, density_square_accumulator, density_bins, average, error);
+	if(position)
+		for(int i=0;i<density_bins;i++)
+			position[i] = histogram_start+(i+0.5)*delta_pos;
+}
+
+void qmc1d_correlation(double* tau, double* average, double* error)
+{
+	blockAverage(correlation_accumulator, correlation_square_accumulator, correlation_lags, average, error);
+	if(tau)
+		for(int i=0;i<correlation_lags;i++)
+			tau[i] = i*dtau;
+}
+
+void qmc1d_acceptances(double* translation, double* bridge, double* motion, double* hmc)
+{
+	*translation = acceptance(acceptedTranslations,totalTranslations);
+	*bridge = acceptance(acceptedBB,totalBB);
+	*motion = PIGS ? acceptance(acceptedBM,totalBM) : 0;
+	*hmc = hmc_attempts ? acceptance(acceptedHMC,totalHMC) : 0;
+}
+
+void qmc1d_write_output()
+{
+	consoleOutput();
+	finalizePotentialEstimator();
+	finalizeKineticEstimator();
+	finalizeHistogram();
+	if(density_bins)
+		finalizeDensity();
+	if(correlation_function)
+		finalizeCorrelation();
+}
+
+void qmc1d_benchmark()
+{
+	benchmark();
+}
+
+/*
+The benchmark runs every combination of the settings listed in "benchmark.dat", one per line as
+"name number_of_values values...", in this order: delta_translation, brownianBridgeReconstructions,
+brownianBridgeAttempts, action (0 primitive, 1 pair action, only if the table is enabled in
+input.dat) and, last, "steps" followed by the number of MC steps to be measured.
+For every setting the polymer is equilibrated from scratch, then the total energy averaged over
+timeslices_interval_for_averages is recorded at every MC step (evaluated on the beads, so that it does
+not depend on the estimator pipeline). The integrated autocorrelation time
+tau of this series (with the self-consistent window of Sokal, W >= 5 tau) gives the variance of its
+mean sigma^2 = var*2tau/steps, and the efficiency 1/(sigma^2 t), where t is the wall time of the steps
+measured with steady_clock (clock() would add the CPU time of the pipeline and bridge threads),
+does not depend on the length of the run: the larger, the better. The move settings, the polymer
+and the acceptances are restored at the end, so that the benchmark can be run between blocks.
+The energy is always the primitive one: with the pair action (action 1) it is not the estimator
+consistent with the sampled distribution, so its efficiency is not comparable with action 0.
+The table is written on the screen and in efficiency.dat.
+*/
+void benchmark()
+{
+	ifstream input_file("benchmark.dat");
+	if(!input_file)
+	{
+		cerr<<"Unable to open benchmark.dat"<<endl;
+		return;
+	}
+	vector<double> settings[4];
+	string string_away;
+	for(int k=0;k<4;k++)
+	{
+		int values;
+		input_file >> string_away >> values;
+		settings[k].resize(values);
+		for(int v=0;v<values;v++)
+			input_file >> settings[k][v];
+	}
+	int steps;
+	input_file >> string_away >> steps;
+	input_file.close();
+	
+	double saved_delta = delta_translation;
+	int saved_reconstructions = brownianBridgeReconstructions;
+	int saved_attempts = brownianBridgeAttempts;
+	int saved_action = pair_action_active;
+	int saved_accepted[2] = {acceptedTranslations, acceptedBB};
+	int saved_total[2] = {totalTranslations, totalBB};
+	double* saved_positions = new double[timeslices];
+	for(int i=0;i<timeslices;i++)
+		saved_positions[i] = positions[i];
+	
+	double* energies = new double[steps];
+	int window = timeslices_averages_end-timeslices_averages_start+1;
+	ofstream out("efficiency.dat");
+	cout<<"delta  BB_length  BB_attempts  action  acc_transl  acc_BB  tau_int  sigma  time  efficiency"<<endl;
+	if(pair_action_points)
+	{
+		cout<<"(action 1: primitive energy on pair action paths, not comparable with action 0)"<<endl;
+		out<<"# action 1: primitive energy on pair action paths, not comparable with action 0"<<endl;
+	}
+	
+	for(unsigned int a=0;a<settings[0].size();a++)
+	for(unsigned int b=0;b<settings[1].size();b++)
+	for(unsigned int c=0;c<settings[2].size();c++)
+	for(unsigned int d=0;d<settings[3].size();d++)
+	{
+		int action = (int)settings[3][d];
+		if(action==1 && !pair_action_points)  // the pair action is not available
+			continue;
+		delta_translation = settings[0][a];
+		brownianBridgeReconstructions = (int)settings[1][b];
+		brownianBridgeAttempts = (int)settings[2][c];
+		if(brownianBridgeReconstructions>timeslices-3)
+			continue;
+		pair_action_active = action;
+		
+		resetPolymer();
+		for(int i=0;i<equilibration;i++)
+			monteCarloStep();
+		acceptedTranslations = totalTranslations = acceptedBB = totalBB = 0;
+		
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for(int i=0;i<steps;i++)
+		{
+			monteCarloStep();
+			double energy = 0;
+			for(int j=timeslices_averages_start;j<=timeslices_averages_end;j++)
+				energy += external_potential(positions[j])+kineticTimeslice(j);
+			energies[i] = energy/window;
+		}
+		double elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+		
+		double variance;
+		double tau = integratedAutocorrelation(energies,steps,variance);
+		double sigma = sqrt(variance*2*tau/steps);
+		double efficiency = 1/(sigma*sigma*elapsed);
+		double acc_transl = acceptance(acceptedTranslations,totalTranslations);
+		double acc_bb = acceptance(acceptedBB,totalBB);
+		
+		cout<<delta_translation<<"  "<<brownianBridgeReconstructions<<"  "<<brownianBridgeAttempts<<"  "<<action<<"  "<<acc_transl<<"  "<<acc_bb<<"  "<<tau<<"  "<<sigma<<"  "<<elapsed<<"  "<<efficiency<<endl;
+		out<<delta_translation<<" "<<brownianBridgeReconstructions<<" "<<brownianBridgeAttempts<<" "<<action<<" "<<acc_transl<<" "<<acc_bb<<" "<<tau<<" "<<sigma<<" "<<elapsed<<" "<<efficiency<<endl;
+	}
+	out.close();
+	delete [] energies;
+	
+	delta_translation = saved_delta;
+	brownianBridgeReconstructions = saved_reconstructions;
+	brownianBridgeAttempts = saved_attempts;
+	pair_action_active = saved_action;
+	acceptedTranslations = saved_accepted[0];
+	acceptedBB = saved_accepted[1];
+	totalTranslations = saved_total[0];
+	totalBB = saved_total[1];
+	for(int i=0;i<timeslices;i++)
+		positions[i] = saved_positions[i];
+	delete [] saved_positions;
+	if(PIGS)
+	{
+		updateTrialCache(LEFT);
+		updateTrialCache(RIGHT);
+	}
+	for(int i=0;i<timeslices;i++)
+		updateTimeslice(i);
+}
+
+// tau_int = 1/2 + sum_t rho(t), with the autocorrelation rho evaluated by FFT. variance is the variance of the series.
+double integratedAutocorrelation(const double* series, int n, double& variance)
+{
+	int size = 1;
+	while(size<2*n)
+		size *= 2;
+	complex<double>* buffer = new complex<double>[size];
+	
+	double mean = 0;
+	for(int i=0;i<n;i++)
+		mean += series[i]/n;
+	for(int i=0;i<size;i++)
+		buffer[i] = (i<n) ? series[i]-mean : 0;
+	fft(buffer,size,-1);
+	for(int i=0;i<size;i++)
+		buffer[i] = norm(buffer[i]);
+	fft(buffer,size,1);
+	
+	variance = buffer[0].real()/size/n;
+	double tau = 0.5;
+	if(variance>0)
+		for(int t=1;t<n && t<5*tau;t++)
+			tau += buffer[t].real()/size/(n-t)/variance;
+	delete [] buffer;
+	return tau;
+}
+
+// The polymer starts again from all zeros, with the estimators and the acceptances reset.
+void resetPolymer()
+{
+	for(int i=0;i<timeslices;i++)
+		positions[i]=0.0;
+	if(PIGS)
+	{
+		updateTrialCache(LEFT);
+		updateTrialCache(RIGHT);
+	}
+	for(int i=0;i<timeslices;i++)
+		updateTimeslice(i);
+}
+
+// A MC step is made of every move of the polymer
+void monteCarloStep()
+{
+	path_steps++;
+	path_moves = 0;
+	
+	if(PIGS)   // only a PIGS polymer has a start and an end. 
+	{
+		brownianMotion(LEFT);
+		brownianMotion(RIGHT);
+	}
+	
+	translation();
+	
+	if(bridge_threads)
+		parallelBridge();
+	else
+		for(int j=0;j<brownianBridgeAttempts;j++) 
+			brownianBridge();
+	
+	for(int j=0;j<hmc_attempts;j++)
+		hybridMonteCarlo();
+}
+
+// The stream of the next move of the current MC step.
+PhiloxStream pathStream()
+{
+	return path_philox.Stream(path_steps, path_moves++);
+}
+
+/* Coarse to fine equilibration: the polymer is first equilibrated with the smallest number of
+timeslices (not lower than coarse_timeslices) from which the target one can be reached by doubling,
+i.e. with a dtau 2^k times larger. Then the resolution is doubled by inserting a free particle
+midpoint between every pair of adjacent beads, and the polymer is equilibrated again for
+coarse_steps MC steps, until the target number of timeslices is reached. The lengths of the
+BB and BM moves are scaled with the resolution. */
+void coarseEquilibration()
+{
+	double target_dtau = dtau;
+	int target_bb = brownianBridgeReconstructions;
+	int target_bm = brownianMotionReconstructions;
+	
+	int levels = 0;
+	while(true)  // PIGS doubles the links (timeslices-1), PIMC the timeslices of the ring
+	{
+		int links = timeslices;
+		if(PIGS)
+			links = timeslices-1;
+		if(links%2 || links/2+PIGS<coarse_timeslices)
+			break;
+		timeslices = links/2+PIGS;
+		levels++;
+	}
+	if(levels==0)
+	{
+		cout<<"Coarse equilibration skipped: no coarser level is reachable from "<<timeslices<<" timeslices"<<endl;
+		cout<<"(the number of links, timeslices"<<(PIGS ? "-1" : "")<<", must be even and its half at least coarse_timeslices)"<<endl;
+	}
+	
+	for(int level=levels;level>=0;level--)
+	{
+		dtau = target_dtau*(1<<level);
+		brownianBridgeReconstructions = max(1,min(target_bb>>level,timeslices-3));
+		brownianMotionReconstructions = max(0,min(target_bm>>level,timeslices-3));
+		if(PIGS)
+		{
+			updateTrialCache(LEFT);
+			updateTrialCache(RIGHT);
+		}
+		if(hmc_attempts)
+			setupHybridMonteCarlo();
+		pair_action_active = (level==0 && pair_action_points>0);  // the table holds only the target dtau
+		
+		if(level==0)
+			break;
+		
+		for(int i=0;i<coarse_steps;i++)
+			monteCarloStep();
+		cout<<"Equilibrated "<<timeslices<<" timeslices"<<endl;
+		
+		doubleTimeslices();
+	}
+	
+	brownianBridgeReconstructions = target_bb;
+	brownianMotionReconstructions = target_bm;
+	for(int i=0;i<timeslices;i++)
+		updateTimeslice(i);
+}
+
+// Every bead keeps its position and a midpoint, sampled from the free particle propagator, is inserted after it.
+void doubleTimeslices()
+{
+	int old_timeslices = timeslices;
+	for(int i=old_timeslices-1;i>=0;i--)
+		positions[2*i] = positions[i];
+	
+	timeslices = 2*old_timeslices-PIGS;
+	double fine_dtau = dtau/2;
+	PhiloxStream rng = pathStream();
+	for(int i=1;i<timeslices;i+=2)
+	{
+		double average_position = (positions[i-1]+positions[index_mask(i+1)])/2;
+		positions[i] = rng.Gaus(average_position,sqrt(lambda*fine_dtau));
+	}
+}
+
+// This is the primitive approximation without the kinetic correlation
+// (or the matrix squaring one, when the table has been computed)
+double potential_density_matrix(double val, double val_next)
+{
+	if(pair_action_active)
+		return -pairAction(val,val_next);
+	
+	double dens_left = -dtau*external_potential(val)/2;
+	double dens_right = -dtau*external_potential(val_next)/2;
+	
+	return dens_left+dens_right;
+}
+
+// Initialization of the variables and allocation of the memory.
+void initialize()
+{
+	lambda = hbar*hbar/(2*mass);
+	if(temperature==0)
+		PIGS=1;
+	else
+		PIGS=0;
+	
+	if(PIGS)
+		dtau = imaginaryTimePropagation/(timeslices-1);
+	else
+		dtau = hbar/(boltzmann*temperature*timeslices);
+	
+	acceptedTranslations=0;
+	acceptedVariational=0;
+	acceptedBB=0;
+        acceptedBM=0;
+	acceptedHMC=0;
+	totalTranslations=0;
+	totalVariational=0;
+	totalBB=0;
+        totalBM=0;
+	totalHMC=0;
+	
+	path_philox = Philox(seed, 1);
+	path_steps = 0;
+	path_moves = 0;
+	completed_blocks=0;
+	
+	positions=new double[timeslices];
+	potential_energy=new double[timeslices];
+	potential_energy_accumulator=new double[timeslices];
+	potential_energy_square_accumulator=new double[timeslices];
+                                                                                                                 
+	kinetic_energy=new double[timeslices];
+	kinetic_energy_accumulator=new double[timeslices];
+	kinetic_energy_square_accumulator=new double[timeslices];
+                                                                                                                
+	positions_histogram=new double[histogram_bins];
+	positions_histogram_accumulator=new double[histogram_bins];
+	positions_histogram_square_accumulator=new double[histogram_bins];
+	
+	potential_current=new double[timeslices];
+	kinetic_current=new double[timeslices];
+	histogram_bin=new int[timeslices];
+	density_bin=new int[timeslices];
+	last_measurement=new int[timeslices];
+	
+	for(int i=0;i<timeslices;i++)
+		positions[i]=0.0;
+	
+	if(trial_wavefunction)
+		exactDiagonalization();
+	
+	if(PIGS)
+	{
+		updateTrialCache(LEFT);
+		updateTrialCache(RIGHT);
+	}
+	
+	for(int i=0;i<timeslices;i++)
+	{
+		potential_energy[i]=0;
+		potential_energy_accumulator[i]=0;
+		potential_energy_square_accumulator[i]=0;
+
+		kinetic_energy[i]=0;
+		kinetic_energy_accumulator[i]=0;
+		kinetic_energy_square_accumulator[i]=0;
+	}
+	
+	measurements=0;
+	for(int i=0;i<timeslices;i++)
+	{
+		updateTimeslice(i);
+		last_measurement[i]=0;
+	}
+	
+	for(int i=0;i<histogram_bins;i++)
+	{
+		positions_histogram[i]=0;
+		positions_histogram_accumulator[i]=0;
+		positions_histogram_square_accumulator[i]=0;
+	}
+	
+	if(density_bins)
+	{
+		density_fft_size = 1;
+		while(density_fft_size < 2*density_bins)  // zero padding: the kernel must not wrap around the grid
+			density_fft_size *= 2;
+		density_histogram=new double[density_bins]();
+		density_accumulator=new double[density_bins]();
+		density_square_accumulator=new double[density_bins]();
+		density_kernel=new complex<double>[density_fft_size];
+		density_fft_buffer=new complex<double>[density_fft_size];
+		if(density_bandwidth>0)
+			setupDensityKernel();
+	}
+	
+	/* PIMC: the ring polymer is periodic, so the lags go from 0 to timeslices/2.
+	   PIGS: only the central part of the polymer (timeslices_interval_for_averages)
+	   samples the ground state, so the correlation is evaluated on that window. */
+	int correlation_points = timeslices;
+	if(PIGS)
+		correlation_points = timeslices_averages_end-timeslices_averages_start+1;
+	correlation_lags = correlation_points;
+	if(!PIGS)
+		correlation_lags = timeslices/2+1;
+	
+	correlation_fft_size = 1;
+	while(correlation_fft_size < 2*correlation_points)  // zero padding avoids the circular wrap-around
+		correlation_fft_size *= 2;
+	
+	correlation=new double[correlation_lags];
+	correlation_accumulator=new double[correlation_lags];
+	correlation_square_accumulator=new double[correlation_lags];
+	correlation_fft_buffer=new complex<double>[correlation_fft_size];
+	
+	for(int i=0;i<correlation_lags;i++)
+	{
+		correlation[i]=0;
+		correlation_accumulator[i]=0;
+		correlation_square_accumulator[i]=0;
+	}
+	
+	if(bridge_threads)
+	{
+		int max_domains = timeslices/bridge_domain_length+2;
+		bridge_domain_start=new int[max_domains];
+		bridge_domain_links=new int[max_domains];
+		bridge_domain_accepted=new int[max_domains];
+		bridge_domain_total=new int[max_domains];
+		bridge_philox=Philox(seed);
+		bridge_sweeps=0;
+		
+		bridge_generation=0;
+		bridge_stop=false;
+		bridge_pool=new thread[bridge_threads];
+		for(int t=1;t<bridge_threads;t++)  // the main thread is the thread 0
+			bridge_pool[t]=thread(bridgeWork);
+	}
+	
+	if(hmc_attempts)
+	{
+		hmc_positions=new double[timeslices];
+		hmc_momenta=new double[timeslices];
+		hmc_velocities=new double[timeslices];
+		hmc_forces=new double[timeslices];
+		hmc_mass_diagonal=new double[timeslices];
+		hmc_mass_subdiagonal=new double[timeslices];
+		hmc_mass_last_row=new double[timeslices];
+		setupHybridMonteCarlo();
+	}
+	
+	pair_action_active = 0;
+	if(pair_action_points)
+		setupPairAction();
+	alpha=0;
+}
+
+/* The pair action U(x,x';dtau) = -log(rho(x,x';dtau)/rho_free(x,x';dtau)) is the exact potential part of
+the link action. It is evaluated on a grid of pair_action_points points in [-pair_action_extent,
+pair_action_extent] by matrix squaring: rho is first written in the primitive approximation for
+dtau/2^pair_action_squarings, then rho(x,x';2tau) = sum_k h rho(x,x_k;tau) rho(x_k,x';tau) is
+applied pair_action_squarings times. The quadrature needs a grid spacing h not larger than the
+width sqrt(2 lambda dtau/2^pair_action_squarings) of the first free propagator: on a coarser grid
+the pair action is switched off and the primitive action is used. The squaring costs O(points^3),
+so the table is saved in a file whose name contains potential_label, dtau and the grid, and it is
+read back in later runs only if its header (dtau at full precision, points, extent and squarings)
+matches the current parameters. Where rho (or rho_free) underflows, the primitive value is kept. */
+void setupPairAction()
+{
+	int n = pair_action_points;
+	double h = 2*pair_action_extent/(n-1);
+	double tau = dtau/(1<<pair_action_squarings);
+	double width = sqrt(2*lambda*tau);
+	if(h>width)
+	{
+		cerr<<"Pair action: the grid spacing "<<h<<" is larger than the width "<<width<<" of the free propagator for dtau/2^"
+		    <<pair_action_squarings<<": at least "<<(int)ceil(2*pair_action_extent/width)+1<<" points are needed, or fewer squarings. "
+		    <<"The primitive action is used."<<endl;
+		pair_action_points = 0;
+		return;
+	}
+	pair_action_table = new double[n*n];
+	
+	const char magic[8] = {'Q','M','C','1','D','P','A','1'};
+	ostringstream name;
+	name<<"pairAction_"<<potential_label<<"_dtau"<<dtau<<"_n"<<n<<"_x"<<pair_action_extent<<"_sq"<<pair_action_squarings<<".bin";
+	ifstream cached(name.str().c_str(), ios::binary);
+	if(cached)
+	{
+		char file_magic[8];
+		double file_dtau, file_extent;
+		int file_points, file_squarings;
+		cached.read(file_magic, sizeof(file_magic));
+		cached.read((char*)&file_dtau, sizeof(double));
+		cached.read((char*)&file_points, sizeof(int));
+		cached.read((char*)&file_extent, sizeof(double));
+		cached.read((char*)&file_squarings, sizeof(int));
+		if(cached && memcmp(file_magic, magic, sizeof(magic))==0 && file_dtau==dtau && file_points==n
+		   && file_extent==pair_action_extent && file_squarings==pair_action_squarings
+		   && cached.read((char*)pair_action_table, n*n*sizeof(double)))
+		{
+			cout<<"Pair action read from "<<name.str()<<endl;
+			cached.close();
+			pair_action_active = 1;
+			return;
+		}
+		cout<<"The header of "<<name.str()<<" does not match the parameters of this run: the pair action is computed again"<<endl;
+		cached.close();
+	}
+	
+	double* rho = new double[n*n];
+	double* squared = new double[n*n];
+	for(int i=0;i<n;i++)
+		for(int j=0;j<n;j++)
+		{
+			double x = -pair_action_extent+i*h;
+			double y = -pair_action_extent+j*h;
+			rho[i*n+j] = exp(-(x-y)*(x-y)/(4*lambda*tau)-tau*(external_potential(x)+external_potential(y))/2)/sqrt(4*M_PI*lambda*tau);
+		}
+	
+	for(int s=0;s<pair_action_squarings;s++)
+	{
+		for(int i=0;i<n*n;i++)
+			squared[i] = 0;
+		for(int i=0;i<n;i++)
+			for(int k=0;k<n;k++)
+			{
+				double rho_ik = h*rho[i*n+k];
+				for(int j=0;j<n;j++)
+					squared[i*n+j] += rho_ik*rho[k*n+j];
+			}
+		swap(rho,squared);
+		tau *= 2;
+	}
+	
+	for(int i=0;i<n;i++)
+		for(int j=0;j<n;j++)
+		{
+			double x = -pair_action_extent+i*h;
+			double y = -pair_action_extent+j*h;
+			double free_rho = exp(-(x-y)*(x-y)/(4*lambda*dtau))/sqrt(4*M_PI*lambda*dtau);
+			if(rho[i*n+j]>1e-280 && free_rho>1e-280)
+				pair_action_table[i*n+j] = -log(rho[i*n+j]/free_rho);
+			else
+				pair_action_table[i*n+j] = dtau*(external_potential(x)+external_potential(y))/2;
+		}
+	delete [] rho;
+	delete [] squared;
+	
+	ofstream out(name.str().c_str(), ios::binary);
+	out.write(magic, sizeof(magic));
+	out.write((char*)&dtau, sizeof(double));
+	out.write((char*)&n, sizeof(int));
+	out.write((char*)&pair_action_extent, sizeof(double));
+	out.write((char*)&pair_action_squarings, sizeof(int));
+	out.write((char*)pair_action_table, n*n*sizeof(double));
+	out.close();
+	cout<<"Pair action computed and saved in "<<name.str()<<endl;
+	pair_action_active = 1;
+}
+
+// Bilinear interpolation of the table, the primitive approximation outside the grid.
+double pairAction(double val, double val_next)
+{
+	double h = 2*pair_action_extent/(pair_action_points-1);
+	double u = (val+pair_action_extent)/h;
+	double v = (val_next+pair_action_extent)/h;
+	int i = (int)floor(u);
+	int j = (int)floor(v);
+	if(i<0 || j<0 || i>=pair_action_points-1 || j>=pair_action_points-1)
+		return dtau*(external_potential(val)+external_potential(val_next))/2;
+	
+	u -= i;
+	v -= j;
+	const double* row = pair_action_table+i*pair_action_points+j;
+	return (1-u)*((1-v)*row[0]+v*row[1]) + u*((1-v)*row[pair_action_points]+v*row[pair_action_points+1]);
+}
+
+/* exactDiagonalization solves -lambda psi'' + V psi = E psi with finite differences on trial_points
+points in [-trial_extent, trial_extent] (psi vanishes at the borders). The sparse hamiltonian is
+reduced by the Lanczos algorithm, with full reorthogonalization, to a tridiagonal matrix whose two
+lowest eigenvalues are found by bisection on the Sturm sequence and whose ground state by inverse
+iteration. The energies are written on the screen as a reference for the simulation, the ground
+state density in groundState.dat. log(psi) of the ground state is tabulated in trial_log_psi and
+used as trial wave function by PIGS, its local energy is E0-V(x). */
+void exactDiagonalization()
+{
+	int n = trial_points;
+	double h = 2*trial_extent/(n-1);
+	double hopping = -lambda/(h*h);
+	double* diagonal = new double[n];
+	for(int i=0;i<n;i++)
+		diagonal[i] = 2*lambda/(h*h)+external_potential(-trial_extent+i*h);
+	
+	int max_steps = min(n,600);
+	double* basis = new double[n*max_steps];
+	double* alpha_lanczos = new double[max_steps];
+	double* beta_lanczos = new double[max_steps];
+	double* w = new double[n];
+	double* ground = new double[max_steps];
+	
+	PhiloxStream rng = path_philox.Stream(0, 0);  // the step 0 is the set up
+	double norm_start = 0;
+	for(int i=0;i<n;i++)
+	{
+		basis[i] = rng.Rndm()-0.25;  // mostly positive: it overlaps the ground state, but also the odd states
+		norm_start += basis[i]*basis[i];
+	}
+	for(int i=0;i<n;i++)
+		basis[i] /= sqrt(norm_start);
+	
+	int steps = 0;
+	double energies[2] = {0,0};
+	while(steps<max_steps)
+	{
+		double* q = basis+steps*n;
+		for(int i=0;i<n;i++)  // w = H q
+		{
+			w[i] = diagonal[i]*q[i];
+			if(i>0)
+				w[i] += hopping*q[i-1];
+			if(i<n-1)
+				w[i] += hopping*q[i+1];
+		}
+		alpha_lanczos[steps] = 0;
+		for(int i=0;i<n;i++)
+			alpha_lanczos[steps] += q[i]*w[i];
+		for(int k=0;k<=steps;k++)  // full reorthogonalization
+		{
+			double overlap = 0;
+			for(int i=0;i<n;i++)
+				overlap += basis[k*n+i]*w[i];
+			for(int i=0;i<n;i++)
+				w[i] -= overlap*basis[k*n+i];
+		}
+		double norm_w = 0;
+		for(int i=0;i<n;i++)
+			norm_w += w[i]*w[i];
+		beta_lanczos[steps] = sqrt(norm_w);
+		steps++;
+		
+		if(steps%10==0 || steps==max_steps || beta_lanczos[steps-1]<1e-12)
+		{
+			energies[0] = tridiagonalEigenvalue(alpha_lanczos,beta_lanczos,steps,0);
+			if(steps>1)
+				energies[1] = tridiagonalEigenvalue(alpha_lanczos,beta_lanczos,steps,1);
+			tridiagonalEigenvector(alpha_lanczos,beta_lanczos,steps,energies[0],ground);
+			if(beta_lanczos[steps-1]*fabs(ground[steps-1])<1e-9)  // residual of the Ritz vector
+				break;
+		}
+		if(steps<max_steps)
+			for(int i=0;i<n;i++)
+				basis[steps*n+i] = w[i]/beta_lanczos[steps-1];
+	}
+	
+	trial_energy = energies[0];
+	trial_log_psi = new double[n];
+	double largest = 0;
+	for(int i=0;i<n;i++)  // psi is stored in w, its sign is fixed by the largest component
+	{
+		w[i] = 0;
+		for(int k=0;k<steps;k++)
+			w[i] += ground[k]*basis[k*n+i];
+		if(fabs(w[i])>fabs(largest))
+			largest = w[i];
+	}
+	double sign = (largest>0) ? 1 : -1;
+	ofstream out("groundState.dat");
+	for(int i=0;i<n;i++)
+	{
+		double psi = max(sign*w[i],1e-300);
+		trial_log_psi[i] = log(psi);
+		out<<-trial_extent+i*h<<" "<<psi*psi/h<<endl;
+	}
+	out.close();
+	
+	cout<<"Exact diagonalization ("<<steps<<" Lanczos steps): E0 = "<<energies[0]<<" E1 = "<<energies[1]<<" gap = "<<energies[1]-energies[0]<<endl;
+	
+	delete [] diagonal;
+	delete [] basis;
+	delete [] alpha_lanczos;
+	delete [] beta_lanczos;
+	delete [] w;
+	delete [] ground;
+}
+
+// The index-th eigenvalue (from the lowest) of the tridiagonal matrix, by bisection on the Sturm sequence.
+double tridiagonalEigenvalue(const double* diagonal, const double* offdiagonal, int n, int index)
+{
+	double lower = diagonal[0], upper = diagonal[0];
+	for(int i=0;i<n;i++)  // Gershgorin bounds
+	{
+		double radius = fabs(offdiagonal[i]);
+		if(i>0)
+			radius += fabs(offdiagonal[i-1]);
+		lower = min(lower,diagonal[i]-radius);
+		upper = max(upper,diagonal[i]+radius);
+	}
+	
+	for(int iteration=0;iteration<200 && upper-lower>1e-14*max(1.,fabs(upper));iteration++)
+	{
+		double middle = (lower+upper)/2;
+		int below = 0;  // number of eigenvalues lower than middle
+		double q = 1;
+		for(int i=0;i<n;i++)
+		{
+			double coupling = 0;
+			if(i>0)
+				coupling = offdiagonal[i-1]*offdiagonal[i-1]/q;
+			q = diagonal[i]-middle-coupling;
+			if(q==0)
+				q = 1e-300;
+			if(q<0)
+				below++;
+		}
+		if(below>index)
+			upper = middle;
+		else
+			lower = middle;
+	}
+	return (lower+upper)/2;
+}
+
+// The normalized eigenvector of the tridiagonal matrix for the eigenvalue "energy", by inverse iteration.
+void tridiagonalEigenvector(const double* diagonal, const double* offdiagonal, int n, double energy, double* vec)
+{
+	double shift = energy-1e-10*max(1.,fabs(energy));
+	double* c = new double[n];
+	for(int i=0;i<n;i++)
+		vec[i] = 1;
+	for(int iteration=0;iteration<3;iteration++)
+	{
+		for(int i=0;i<n;i++)  // Thomas algorithm for (T-shift) y = vec
+		{
+			double pivot = diagonal[i]-shift;
+			if(i>0)
+			{
+				pivot -= offdiagonal[i-1]*c[i-1];
+				vec[i] -= offdiagonal[i-1]*vec[i-1];
+			}
+			c[i] = offdiagonal[i]/pivot;
+			vec[i] /= pivot;
+		}
+		for(int i=n-2;i>=0;i--)
+			vec[i] -= c[i]*vec[i+1];
+		
+		double norm_vec = 0;
+		for(int i=0;i<n;i++)
+			norm_vec += vec[i]*vec[i];
+		for(int i=0;i<n;i++)
+			vec[i] /= sqrt(norm_vec);
+	}
+	delete [] c;
+}
+
+// Linear interpolation of the tabulated log(psi) (derivative=0) or of its slope (derivative=1).
+// Out of the grid psi vanishes, as in the exact diagonalization.
+double tabulatedLogWaveFunction(double val, int derivative)
+{
+	double h = 2*trial_extent/(trial_points-1);
+	double u = (val+trial_extent)/h;
+	int i = (int)floor(u);
+	if(i<0 || i>=trial_points-1)
+		return derivative ? 0 : -HUGE_VAL;
+	
+	if(derivative)
+		return (trial_log_psi[i+1]-trial_log_psi[i])/h;
+	u -= i;
+	return (1-u)*trial_log_psi[i]+u*trial_log_psi[i+1];
+}
+
+// The external potential. You can modify this function but don't forget
+// to modify its first and second derivatives too !
+double external_potential(double val)
+{
+	return pow(val, 4) - 5./2. * pow(val, 2);
+}
+
+double external_potential_prime(double val)
+{
+	return 4 * pow(val, 3) - 5 * val;
+}
+
+double external_potential_second(double val)
+{
+	return 12 * pow(val, 2) - 5;
+}
+
+// The same applies to the variational Wave Function...
+// You can modify this function but don't forget
+// to modify its logarithm, its second derivative and the local energy below!
+double variationalWaveFunction(double val)
+{
+	double fact = 1/(2 * sigma_wf * sigma_wf);
+	return exp(-(val - mu_wf) * (val - mu_wf) * fact) + exp(-(val + mu_wf) * (val + mu_wf) * fact);
+}
+
+// log(psi) = -(x^2+mu^2)/(2sigma^2) + log(2cosh(x*mu/sigma^2)), written so that it never overflows
+double logVariationalWaveFunction(double val)
+{
+	if(trial_wavefunction)
+		return tabulatedLogWaveFunction(val,0);
+	
+	double s2 = sigma_wf * sigma_wf;
+	double y = fabs(val * mu_wf/s2);
+	return -(val * val + mu_wf * mu_wf)/(2 * s2) + y + log1p(exp(-2 * y));
+}
+
+// d/dx log(psi), the force of the trial wave function on the end beads
+double logVariationalWaveFunction_prime(double val)
+{
+	if(trial_wavefunction)
+		return tabulatedLogWaveFunction(val,1);
+	
+	double s2 = sigma_wf * sigma_wf;
+	return (-val + mu_wf * tanh(val * mu_wf/s2))/s2;
+}
+
+double variationalWaveFunction_second(double val)
+{
+	double s2 = sigma_wf * sigma_wf;
+	double compl_term = 2 * val * mu_wf * tanh(val * mu_wf/s2);
+
+	return variationalWaveFunction(val) * (val * val + mu_wf * mu_wf - s2 - compl_term)/(s2 * s2); 
+}
+
+// The trial wave function enters the acceptance only through the end beads,
+// so log psi and the local energy are evaluated again only when one of them moves.
+void updateTrialCache(int which)
+{
+	if(which==LEFT)
+	{
+		log_psi_left = logVariationalWaveFunction(positions[0]);
+		local_energy_left = variationalLocalEnergy(positions[0]);
+	}
+	else
+	{
+		log_psi_right = logVariationalWaveFunction(positions[timeslices-1]);
+		local_energy_right = variationalLocalEnergy(positions[timeslices-1]);
+	}
+}
+
+void translation()
+{
+	totalTranslations++;
+	PhiloxStream rng = pathStream();
+	double delta = rng.Uniform(-delta_translation,delta_translation);
+	double acc_density_matrix_difference=0;
+	int last = timeslices;
+	if(PIGS)
+		last=timeslices-1;
+		
+	for(int i=0;i<last;i++)
+	{
+		int inext = index_mask(i+1);
+		double newcorr,oldcorr;
+		newcorr = potential_density_matrix(positions[i]+delta,positions[inext]+delta);
+		oldcorr = potential_density_matrix(positions[i],positions[inext]);
+		acc_density_matrix_difference += oldcorr-newcorr;
+	}
+	// metropolis: PIGS contains also the statistical weight of the variational Wave Function.
+	// Its value at the old ends is cached, only the new ends have to be evaluated.
+	double log_acceptance = -acc_density_matrix_difference;
+	double new_log_psi_left = 0, new_log_psi_right = 0;
+	if(PIGS)
+	{
+		new_log_psi_left = logVariationalWaveFunction(positions[0]+delta);
+		new_log_psi_right = logVariationalWaveFunction(positions[timeslices-1]+delta);
+		log_acceptance += new_log_psi_left-log_psi_left + new_log_psi_right-log_psi_right;
+	}
+	double acceptance_probability = exp(log_acceptance);
+	
+	if(rng.Rndm()<acceptance_probability)
+	{
+		for(int i=0;i<timeslices;i++)
+			positions[i]+=delta;
+		if(PIGS)
+		{
+			log_psi_left = new_log_psi_left;
+			log_psi_right = new_log_psi_right;
+			local_energy_left = variationalLocalEnergy(positions[0]);
+			local_energy_right = variationalLocalEnergy(positions[timeslices-1]);
+		}
+		beadsChanged(0,timeslices);
+		acceptedTranslations++;
+	}
+}
+
+/* BB removes a segment of the polymer, in this case from "starting_point+1" to "endpoint-1"
+and replaces it with a free particle propagation. The free particle propagation is achieved
+with the gaussian sampling of the kinetic part of the density matrix.
+The function index_mask handles the compatibility between PIGS and PIMC: in PIGS the polymer is 
+open, so you can't have a starting index greater than an ending index. In PIMC, instead, you
+have a ring polymer so when you reach the end you can continue from the beginning. 
+The compatibility solution that has been chosen consists in viewing the ring polymer as an open
+polymer that has been closed on periodic boundary contitions. index_mask takes this into account. */
+void brownianBridge()
+{
+	totalBB++;
+	int available_starting_points = timeslices-brownianBridgeReconstructions-1; // for PIGS simulation
+	if(!PIGS)
+		available_starting_points = timeslices-1;
+	PhiloxStream rng = pathStream();
+	int starting_point = (int)(rng.Rndm()*available_starting_points);
+	
+	if(bridgeSegment(starting_point,brownianBridgeReconstructions,rng))
+	{
+		beadsChanged(starting_point+1,brownianBridgeReconstructions);
+		acceptedBB++;
+	}
+}
+
+/* bridgeSegment performs the actual reconstruction of the beads from "starting_point+1" to
+"starting_point+reconstructions" with the random numbers of "rng" (a PhiloxStream), and returns 1 if the move
+has been accepted. It only reads and writes the beads from starting_point to its endpoint, so
+moves on segments that do not overlap can run at the same time. */
+template<class Generator> int bridgeSegment(int starting_point, int reconstructions, Generator& rng)
+{
+	int endpoint = index_mask(starting_point + reconstructions + 1);
+	
+	double starting_coord = positions[index_mask(starting_point)];
+	double ending_coord = positions[endpoint];
+	double new_segment[reconstructions+2];
+	new_segment[0]=starting_coord;
+	new_segment[reconstructions+1]=ending_coord;
+	double previous_position = starting_coord;
+	for(int i=0;i<reconstructions;i++)
+	{
+		int left_reco = reconstructions-i;
+		// gaussian sampling of the free particle propagator
+		double average_position = previous_position + (ending_coord-previous_position)/(left_reco+1);
+		double variance = 2*lambda*dtau*left_reco/(left_reco+1);
+		double newcoordinate = rng.Gaus(average_position,sqrt(variance));
+		new_segment[i+1] = newcoordinate;
+		previous_position=newcoordinate;
+	}
+	
+	// metropolis. Note that the kinetic part has been sampled exactely, thus only the
+	// potential part of the density matrix determines the acceptance probability of the move.
+	double acc_density_matrix_difference=0;
+	for(int i=0;i<reconstructions+1;i++)
+	{
+		int i_old = index_mask(starting_point+i);
+		int i_next_old = index_mask(starting_point+i+1);
+		double newcorr,oldcorr;
+		newcorr = potential_density_matrix(new_segment[i],new_segment[i+1]);
+		oldcorr = potential_density_matrix(positions[i_old],positions[i_next_old]);
+		acc_density_matrix_difference += oldcorr-newcorr;
+	}
+	
+	double acceptance_probability = exp(-acc_density_matrix_difference);
+	if(rng.Rndm()<acceptance_probability)
+	{
+		for(int i=1;i<reconstructions+1;i++)
+		{
+			int i_old = index_mask(starting_point+i);
+			positions[i_old]=new_segment[i];
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/* parallelBridge splits the polymer in domains of bridge_domain_length links, separated by
+boundary beads that are kept fixed (in PIGS the two ends are boundary beads too, they are moved
+by BM). Every domain receives brownianBridgeAttempts bridge moves that never touch its boundaries,
+so the domains are independent and are updated concurrently by bridge_threads threads.
+The boundaries are shifted by a random offset at every sweep, so that every bead can move
+and the composition of the domain updates satisfies detailed balance. */
+void parallelBridge()
+{
+	int offset = (int)(pathStream().Rndm()*bridge_domain_length);
+	
+	bridge_domains = 0;
+	if(PIGS)
+	{
+		int boundary = 0;
+		int next = offset;
+		if(next==0)
+			next = bridge_domain_length;
+		while(boundary<timeslices-1)
+		{
+			if(next>timeslices-1)
+				next = timeslices-1;
+			bridge_domain_start[bridge_domains] = boundary;
+			bridge_domain_links[bridge_domains] = next-boundary;
+			bridge_domains++;
+			boundary = next;
+			next += bridge_domain_length;
+		}
+	}
+	else  // the ring is cut at the offset, the last domain may be shorter
+	{
+		for(int boundary=0;boundary<timeslices;boundary+=bridge_domain_length)
+		{
+			bridge_domain_start[bridge_domains] = offset+boundary;
+			bridge_domain_links[bridge_domains] = min(bridge_domain_length,timeslices-boundary);
+			bridge_domains++;
+		}
+	}
+	
+	bridge_sweeps++;
+	bridge_next_domain = 0;
+	{
+		lock_guard<mutex> lock(bridge_mutex);
+		bridge_idle_threads = 0;
+		bridge_generation++;
+	}
+	bridge_start.notify_all();
+	updateDomains();
+	{  // a thread is idle only after it has finished its domains, so then every domain is done
+		unique_lock<mutex> lock(bridge_mutex);
+		bridge_done.wait(lock, []{ return bridge_idle_threads==bridge_threads-1; });
+	}
+	
+	for(int d=0;d<bridge_domains;d++)
+	{
+		totalBB += bridge_domain_total[d];
+		acceptedBB += bridge_domain_accepted[d];
+		if(bridge_domain_accepted[d])
+			beadsChanged(bridge_domain_start[d]+1,bridge_domain_links[d]-1);
+	}
+}
+
+void updateDomains()
+{
+	int d;
+	while((d=bridge_next_domain.fetch_add(1))<bridge_domains)
+	{
+		int first = bridge_domain_start[d];
+		int links = bridge_domain_links[d];
+		int reconstructions = min(brownianBridgeReconstructions,links-1);
+		bridge_domain_total[d] = 0;
+		bridge_domain_accepted[d] = 0;
+		PhiloxStream rng = bridge_philox.Stream(bridge_sweeps, d);
+		if(reconstructions>0)
+		{
+			for(int j=0;j<brownianBridgeAttempts;j++)
+			{
+				int starting_point = first+(int)(rng.Rndm()*(links-reconstructions));
+				bridge_domain_total[d]++;
+				bridge_domain_accepted[d] += bridgeSegment(starting_point,reconstructions,rng);
+			}
+		}
+	}
+}
+
+void bridgeWork()
+{
+	int seen = 0;
+	while(true)
+	{
+		{
+			unique_lock<mutex> lock(bridge_mutex);
+			bridge_start.wait(lock, [&]{ return bridge_generation!=seen || bridge_stop; });
+			if(bridge_stop)
+				return;
+			seen = bridge_generation;
+		}
+		updateDomains();
+		{
+			lock_guard<mutex> lock(bridge_mutex);
+			bridge_idle_threads++;
+		}
+		bridge_done.notify_one();
+	}
+}
+
+/* BM removes a segment at one of the two ends of the polymer,
+and replaces it with a free particle propagation using a Brownian Bridge after the sampling of the
+starting (left move) or final (right move) position. The free particle propagation is achieved
+with the gaussian sampling of the kinetic part of the density matrix. */
+void brownianMotion(int which) // BM is called only for PIGS simulations
+{
+	int starting_point, endpoint, left_reco;
+        double starting_coord, ending_coord, average_position, variance, newposition, old_log_psi;
+
+        totalBM++;
+        PhiloxStream rng = pathStream();
+
+        if(which==LEFT)
+        {
+                starting_point = 0;
+                endpoint = brownianMotionReconstructions+1;
+		ending_coord = positions[endpoint];
+		average_position = ending_coord;
+                variance = 2*lambda*dtau*(brownianMotionReconstructions+1);
+		starting_coord = rng.Gaus(average_position,sqrt(variance));
+                old_log_psi = log_psi_left;
+                newposition = starting_coord;
+        }
+        else
+        {
+		starting_point = timeslices-2-brownianMotionReconstructions;
+		endpoint = timeslices-1;
+		starting_coord = positions[starting_point];
+                average_position = starting_coord;
+                variance = 2*lambda*dtau*(brownianMotionReconstructions+1);
+		ending_coord = rng.Gaus(average_position,sqrt(variance));
+		old_log_psi = log_psi_right;
+		newposition = ending_coord;
+        }
+
+        double new_segment[brownianMotionReconstructions+2];
+        new_segment[0]=starting_coord;
+        new_segment[brownianMotionReconstructions+1]=ending_coord;
+        double previous_position = starting_coord;
+        for(int i=0; i<brownianMotionReconstructions; i++)
+        {
+                left_reco = brownianMotionReconstructions-i;
+                // gaussian sampling of the free particle propagator
+                average_position = previous_position + (ending_coord-previous_position)/(left_reco+1);
+                variance = 2*lambda*dtau*left_reco/(left_reco+1);
+                double newcoordinate = rng.Gaus(average_position,sqrt(variance));
+                new_segment[i+1] = newcoordinate;
+                previous_position=newcoordinate;
+        }
+
+        // metropolis. Note that the kinetic part has been sampled exactely, thus only the
+        // potential part of the density matrix determines the acceptance probability of the move.
+        double acc_density_matrix_difference=0;
+        for(int i=0;i<brownianMotionReconstructions+1;i++)
+        {
+                double newcorr,oldcorr;
+                newcorr = potential_density_matrix(new_segment[i],new_segment[i+1]);
+                oldcorr = potential_density_matrix(positions[starting_point+i],positions[starting_point+i+1]);
+                acc_density_matrix_difference += oldcorr-newcorr;
+        }
+
+        double new_log_psi = logVariationalWaveFunction(newposition);
+        double acceptance_probability = exp(-acc_density_matrix_difference + new_log_psi - old_log_psi);
+        if(rng.Rndm()<acceptance_probability)
+        {
+                for(int i=0;i<brownianMotionReconstructions+2;i++)
+                {
+                        positions[starting_point+i]=new_segment[i];
+                }
+                if(which==LEFT)
+                {
+                        log_psi_left = new_log_psi;
+                        local_energy_left = variationalLocalEnergy(newposition);
+                }
+                else
+                {
+                        log_psi_right = new_log_psi;
+                        local_energy_right = variationalLocalEnergy(newposition);
+                }
+                beadsChanged(starting_point,brownianMotionReconstructions+2);
+                acceptedBM++;
+        }
+}
+
+/* HMC moves every bead at once: the polymer is given gaussian momenta p with covariance M (the
+mass matrix), it is evolved with the fictitious hamiltonian H = S(x) + p M^-1 p/2 for hmc_steps
+leapfrog steps of length hmc_stepsize, and the final configuration is accepted with probability
+exp(-dH). S is the full action of the polymer (see polymerAction).
+With hmc_normal_modes M = K + dtau, where K is the free particle (spring) part of the hessian of S:
+every normal mode of the free polymer then oscillates at the same rate and the stiff high
+frequency modes no longer limit the step size. M is tridiagonal (cyclic for the ring polymer), so
+its Cholesky factor, stored in hmc_mass_*, gives the sampling of p and M^-1 p in O(M) operations. */
+void hybridMonteCarlo()
+{
+	totalHMC++;
+	PhiloxStream rng = pathStream();
+	int n = timeslices;
+	
+	double kinetic = 0;
+	for(int i=0;i<n;i++)  // z is stored in hmc_velocities, p = L z
+	{
+		hmc_velocities[i] = rng.Gaus(0,1);
+		kinetic += hmc_velocities[i]*hmc_velocities[i]/2;
+	}
+	for(int i=0;i<n-1;i++)
+	{
+		hmc_momenta[i] = hmc_mass_diagonal[i]*hmc_velocities[i];
+		if(i>0)
+			hmc_momenta[i] += hmc_mass_subdiagonal[i-1]*hmc_velocities[i-1];
+	}
+	hmc_momenta[n-1] = hmc_mass_diagonal[n-1]*hmc_velocities[n-1];
+	for(int j=0;j<n-1;j++)
+		hmc_momenta[n-1] += hmc_mass_last_row[j]*hmc_velocities[j];
+	
+	for(int i=0;i<n;i++)
+		hmc_positions[i] = positions[i];
+	double old_hamiltonian = polymerAction(positions)+kinetic;
+	
+	polymerForce(hmc_positions,hmc_forces);
+	for(int step=0;step<hmc_steps;step++)
+	{
+		for(int i=0;i<n;i++)
+			hmc_momenta[i] += hmc_stepsize*hmc_forces[i]/2;
+		massInverse(hmc_momenta,hmc_velocities);
+		for(int i=0;i<n;i++)
+			hmc_positions[i] += hmc_stepsize*hmc_velocities[i];
+		polymerForce(hmc_positions,hmc_forces);
+		for(int i=0;i<n;i++)
+			hmc_momenta[i] += hmc_stepsize*hmc_forces[i]/2;
+	}
+	
+	massInverse(hmc_momenta,hmc_velocities);
+	kinetic = 0;
+	for(int i=0;i<n;i++)
+		kinetic += hmc_momenta[i]*hmc_velocities[i]/2;
+	double new_hamiltonian = polymerAction(hmc_positions)+kinetic;
+	
+	if(rng.Rndm()<exp(old_hamiltonian-new_hamiltonian))
+	{
+		for(int i=0;i<n;i++)
+			positions[i] = hmc_positions[i];
+		if(PIGS)
+		{
+			updateTrialCache(LEFT);
+			updateTrialCache(RIGHT);
+		}
+		beadsChanged(0,timeslices);
+		acceptedHMC++;
+	}
+}
+
+// S(x) = -log of the statistical weight of the polymer, with the density matrix used by the other moves
+double polymerAction(const double* x)
+{
+	double action = 0;
+	int last = timeslices;
+	if(PIGS)
+		last = timeslices-1;
+	for(int i=0;i<last;i++)
+	{
+		int inext = index_mask(i+1);
+		double link = x[i]-x[inext];
+		action += link*link/(4*lambda*dtau) - potential_density_matrix(x[i],x[inext]);
+	}
+	if(PIGS)
+		action -= logVariationalWaveFunction(x[0]) + logVariationalWaveFunction(x[timeslices-1]);
+	return action;
+}
+
+// -dS/dx in the primitive approximation. It only drives the leapfrog: the acceptance uses polymerAction.
+void polymerForce(const double* x, double* force)
+{
+	for(int i=0;i<timeslices;i++)
+		force[i] = -dtau*external_potential_prime(x[i]);
+	
+	int last = timeslices;
+	if(PIGS)
+	{
+		last = timeslices-1;
+		force[0] = force[0]/2 + logVariationalWaveFunction_prime(x[0]);
+		force[timeslices-1] = force[timeslices-1]/2 + logVariationalWaveFunction_prime(x[timeslices-1]);
+	}
+	for(int i=0;i<last;i++)
+	{
+		int inext = index_mask(i+1);
+		double spring = (x[i]-x[inext])/(2*lambda*dtau);
+		force[i] -= spring;
+		force[inext] += spring;
+	}
+}
+
+/* Cholesky factor L of the mass matrix: hmc_mass_diagonal holds its diagonal, hmc_mass_subdiagonal
+the element below the diagonal in the rows 1..n-2, hmc_mass_last_row the row n-1, that is full because
+of the corner element of the ring. Without normal modes M is the identity. */
+void setupHybridMonteCarlo()
+{
+	int n = timeslices;
+	for(int i=0;i<n;i++)
+	{
+		hmc_mass_diagonal[i] = 1;
+		hmc_mass_subdiagonal[i] = 0;
+		hmc_mass_last_row[i] = 0;
+	}
+	if(!hmc_normal_modes)
+		return;
+	
+	double spring = 1/(2*lambda*dtau);
+	double end_diagonal = 2*spring+dtau;
+	if(PIGS)  // the end beads have a single link
+		end_diagonal = spring+dtau;
+	
+	for(int i=0;i<n-1;i++)
+	{
+		double square = 2*spring+dtau;
+		if(i==0)
+			square = end_diagonal;
+		if(i>0)
+			square -= hmc_mass_subdiagonal[i-1]*hmc_mass_subdiagonal[i-1];
+		hmc_mass_diagonal[i] = sqrt(square);
+		if(i<n-2)
+			hmc_mass_subdiagonal[i] = -spring/hmc_mass_diagonal[i];
+	}
+	
+	double last_square = end_diagonal;
+	for(int j=0;j<n-1;j++)
+	{
+		double element = 0;  // element (n-1,j) of M
+		if(j==n-2 || (j==0 && !PIGS))
+			element = -spring;
+		if(j>0)
+			element -= hmc_mass_last_row[j-1]*hmc_mass_subdiagonal[j-1];
+		hmc_mass_last_row[j] = element/hmc_mass_diagonal[j];
+		last_square -= hmc_mass_last_row[j]*hmc_mass_last_row[j];
+	}
+	hmc_mass_diagonal[n-1] = sqrt(last_square);
+}
+
+// velocity = M^-1 momentum, by forward and backward substitution with the Cholesky factor
+void massInverse(const double* momentum, double* velocity)
+{
+	int n = timeslices;
+	for(int i=0;i<n-1;i++)
+	{
+		velocity[i] = momentum[i];
+		if(i>0)
+			velocity[i] -= hmc_mass_subdiagonal[i-1]*velocity[i-1];
+		velocity[i] /= hmc_mass_diagonal[i];
+	}
+	double last = momentum[n-1];
+	for(int j=0;j<n-1;j++)
+		last -= hmc_mass_last_row[j]*velocity[j];
+	velocity[n-1] = last/(hmc_mass_diagonal[n-1]*hmc_mass_diagonal[n-1]);  // forward and backward step at once
+	
+	for(int i=n-2;i>=0;i--)
+	{
+		velocity[i] -= hmc_mass_last_row[i]*velocity[n-1];
+		if(i<n-2)
+			velocity[i] -= hmc_mass_subdiagonal[i]*velocity[i+1];
+		velocity[i] /= hmc_mass_diagonal[i];
+	}
+}
+
+int index_mask(int ind)
+{
+	if(PIGS)
+		return ind;  // no pbc over indices
+	else
+	{
+		int new_ind=ind;
+		while(new_ind>=timeslices)   // pbc over indices
+			new_ind-=timeslices;
+		return new_ind;
+	}
+}
+
+void consoleOutput()
+{
+	cout<<"Acceptances:"<<endl;
+	if(PIGS)
+		cout<<"BM: "<<acceptance(acceptedBM,totalBM)<<endl;
+	cout<<"Transl: "<<acceptance(acceptedTranslations,totalTranslations)<<endl;
+	cout<<"BB: "<<acceptance(acceptedBB,totalBB)<<endl;
+	if(hmc_attempts)
+		cout<<"HMC: "<<acceptance(acceptedHMC,totalHMC)<<endl;
+}
+
+// The fraction of accepted moves, 0 before any move has been attempted
+double acceptance(int accepted, int total)
+{
+	return total ? ((double)accepted)/total : 0;
+}
+
+
+/* This function accumulates the expectation values in their respective variables. 
+   Potential, kinetic energy and histogram are accumulated lazily by beadsChanged(), so here it is
+   enough to count the measurement. At the end of the block, these variables are divided by the
+   number of measurements and the block average and its squared value are accumulated in apposite
+   variables.  
+ */
+void upgradeAverages()
+{
+	measurements++;
+	
+	if(correlation_function)
+		upgradeCorrelation();
+}
+
+/*
+beadsChanged is called after every accepted move with the first moved bead and the number of moved
+beads. A bead enters the potential estimator of its own timeslice and the kinetic estimator of the
+link that starts from it and of the link that ends on it, so the timeslice before the segment is
+updated too. The old values are flushed into the block averages before being replaced.
+*/
+void beadsChanged(int first, int count)
+{
+	if(pipeline_threads)  // the workers evaluate the estimators on the snapshots
+		return;
+	
+	int start = first-1;
+	int end = first+count;
+	if(PIGS && start<0)
+		start = 0;
+	if(!PIGS)  // index_mask only wraps indices beyond the end of the ring
+	{
+		start += timeslices;
+		end += timeslices;
+	}
+	
+	for(int k=start;k<end;k++)
+	{
+		int i = index_mask(k);
+		flushTimeslice(i);
+		updateTimeslice(i);
+	}
+}
+
+void flushTimeslice(int i)
+{
+	int held = measurements-last_measurement[i];
+	if(held>0)
+	{
+		potential_energy[i] += held*potential_current[i];
+		kinetic_energy[i] += held*kinetic_current[i];
+		if(histogram_bin[i]>=0)
+			positions_histogram[histogram_bin[i]] += held;
+		if(density_bin[i]>=0)
+			density_histogram[density_bin[i]] += held;
+	}
+	last_measurement[i] = measurements;
+}
+
+// The kinetic estimator of a timeslice: at the ends of the PIGS polymer the local energy of the trial function
+double kineticTimeslice(int i)
+{
+	if(PIGS && i==0)
+		return local_energy_left;
+	if(PIGS && i==timeslices-1)
+		return local_energy_right;
+	return kineticEstimator(positions[i],positions[index_mask(i+1)]);
+}
+
+void updateTimeslice(int i)
+{
+	potential_current[i] = external_potential(positions[i]);
+	kinetic_current[i] = kineticTimeslice(i);
+	
+	histogram_bin[i] = -1;
+	density_bin[i] = -1;
+	if(i>=timeslices_averages_start && i<=timeslices_averages_end)
+	{
+		histogram_bin[i] = histogramBin(positions[i]);
+		density_bin[i] = densityBin(positions[i]);
+	}
+}
+
+ // The bin of the fine grid of the density estimator, -1 out of the grid (or without the estimator).
+int densityBin(double val)
+{
+	if(!density_bins)
+		return -1;
+	int k = (int)floor((val-histogram_start)/(histogram_end-histogram_start)*density_bins);
+	if(k<0 || k>=density_bins)
+		return -1;
+	return k;
+}
+
+/*
+This functions performs a common way to fill in the values of an histogram. 
+Positions out of [histogram_start, histogram_end] are counted in the first or in the last bin.
+*/
+int histogramBin(double val)
+{
+	double delta_pos = (histogram_end-histogram_start)/histogram_bins;
+	int k = (int)floor((val-histogram_start)/delta_pos);
+	if(k<0)
+		k = 0;
+	if(k>=histogram_bins)
+		k = histogram_bins-1;
+	return k;
+}
+
+/*
+The correlation function C(tau) = <x(0)x(tau)> is evaluated with the Wiener-Khinchin theorem:
+the positions are zero padded to correlation_fft_size, transformed, squared in modulus and 
+transformed back. The k-th element of the result is the sum over i of x(i)x(i+k) without any
+wrap-around, so the cost is O(M log M) instead of the O(M^2) of the double loop.
+For the ring polymer the periodic sum is recovered as L(k)+L(M-k).
+*/
+void upgradeCorrelation()
+{
+	correlationEstimator(positions, correlation, correlation_fft_buffer);
+}
+
+void correlationEstimator(const double* x, double* destination, complex<double>* buffer)
+{
+	int first = 0;
+	int points = timeslices;
+	if(PIGS)
+	{
+		first = timeslices_averages_start;
+		points = timeslices_averages_end-timeslices_averages_start+1;
+	}
+	
+	for(int i=0;i<correlation_fft_size;i++)
+		buffer[i] = 0;
+	for(int i=0;i<points;i++)
+		buffer[i] = x[first+i];
+	
+	fft(buffer, correlation_fft_size, -1);
+	for(int i=0;i<correlation_fft_size;i++)
+		buffer[i] = norm(buffer[i]);
+	fft(buffer, correlation_fft_size, 1);
+	
+	// the inverse transform is not normalized by fft()
+	for(int k=0;k<correlation_lags;k++)
+	{
+		double lagged_sum = buffer[k].real()/correlation_fft_size;
+		if(PIGS)
+			destination[k] += lagged_sum/(points-k);
+		else
+		{
+			if(k>0)
+				lagged_sum += buffer[timeslices-k].real()/correlation_fft_size;
+			destination[k] += lagged_sum/timeslices;
+		}
+	}
+}
+
+// Iterative Cooley-Tukey FFT. n must be a power of two.
+void fft(complex<double>* data, int n, int sign)
+{
+	for(int i=1,j=0;i<n;i++)  // bit reversal permutation
+	{
+		int bit = n>>1;
+		for(;j&bit;bit>>=1)
+			j ^= bit;
+		j ^= bit;
+		if(i<j)
+			swap(data[i],data[j]);
+	}
+	
+	for(int len=2;len<=n;len<<=1)
+	{
+		double angle = sign*2*M_PI/len;
+		complex<double> w_len(cos(angle),sin(angle));
+		for(int i=0;i<n;i+=len)
+		{
+			complex<double> w(1,0);
+			for(int j=0;j<len/2;j++)
+			{
+				complex<double> u = data[i+j];
+				complex<double> v = data[i+j+len/2]*w;
+				data[i+j] = u+v;
+				data[i+j+len/2] = u-v;
+				w *= w_len;
+			}
+		}
+	}
+}
+
+void endBlock()  // calculating and accumulating block averages
+{
+	if(!pipeline_threads)
+		for(int i=0;i<timeslices;i++)
+			flushTimeslice(i);
+	
+	if(measurements==0)  // nothing was measured (measurement_interval > MCSTEPS): the block is not counted
+	{
+		for(int i=0;i<timeslices;i++)
+			last_measurement[i]=0;
+		cerr<<"Block without measurements skipped"<<endl;
+		return;
+	}
+	
+	for(int i=0;i<timeslices;i++)
+	{
+		last_measurement[i]=0;
+		potential_energy[i]/=measurements;
+		potential_energy_accumulator[i]+=potential_energy[i];
+		potential_energy_square_accumulator[i]+=potential_energy[i]*potential_energy[i];
+		potential_energy[i]=0;
+		kinetic_energy[i]/=measurements;
+		kinetic_energy_accumulator[i]+=kinetic_energy[i];
+		kinetic_energy_square_accumulator[i]+=kinetic_energy[i]*kinetic_energy[i];
+		kinetic_energy[i]=0;
+		
+	}
+	
+	for(int i=0;i<histogram_bins;i++)
+	{
+		positions_histogram[i]/=measurements;
+		positions_histogram_accumulator[i]+=positions_histogram[i];
+		positions_histogram_square_accumulator[i]+=positions_histogram[i]*positions_histogram[i];
+		positions_histogram[i]=0;
+	}
+	
+	if(density_bins)
+		endBlockDensity();
+	
+	for(int i=0;i<correlation_lags;i++)
+	{
+		correlation[i]/=measurements;
+		correlation_accumulator[i]+=correlation[i];
+		correlation_square_accumulator[i]+=correlation[i]*correlation[i];
+		correlation[i]=0;
+	}
+	measurements=0;
+	completed_blocks++;
+}
+
+/*
+Kernel density estimator: the positions of the block are binned on a fine grid of density_bins bins
+and convolved with a gaussian kernel of width density_bandwidth, by FFT (the kernel is transformed
+once). If no bandwidth is given, it is chosen with the Silverman rule
+h = 0.9 min(sigma, IQR/1.34) N^(-1/5) on the samples of the first block, and then kept fixed so
+that every block estimates the same smoothed density. The smoothed densities of the blocks are
+averaged as the other estimators.
+*/
+void endBlockDensity()
+{
+	double delta_pos = (histogram_end-histogram_start)/density_bins;
+	double samples = 0;
+	for(int i=0;i<density_bins;i++)
+		samples += density_histogram[i];
+	if(samples==0)
+		return;
+	
+	if(density_bandwidth<=0)
+	{
+		double mean = 0, square = 0;
+		for(int i=0;i<density_bins;i++)
+		{
+			double x = histogram_start+(i+0.5)*delta_pos;
+			mean += x*density_histogram[i]/samples;
+			square += x*x*density_histogram[i]/samples;
+		}
+		double quartiles[2] = {0,0};
+		double cumulative = 0;
+		for(int i=0,q=0;i<density_bins && q<2;i++)
+		{
+			cumulative += density_histogram[i]/samples;
+			while(q<2 && cumulative>=0.25*(2*q+1))
+				quartiles[q++] = histogram_start+(i+1)*delta_pos;
+		}
+		double spread = sqrt(fabs(square-mean*mean));
+		if(quartiles[1]>quartiles[0])
+			spread = min(spread,(quartiles[1]-quartiles[0])/1.34);
+		density_bandwidth = max(0.9*spread*pow(samples,-0.2),delta_pos);
+		cout<<"Density estimator bandwidth: "<<density_bandwidth<<endl;
+		setupDensityKernel();
+	}
+	
+	for(int i=0;i<density_fft_size;i++)
+		density_fft_buffer[i] = 0;
+	for(int i=0;i<density_bins;i++)
+		density_fft_buffer[i] = density_histogram[i]/(samples*delta_pos);
+	fft(density_fft_buffer,density_fft_size,-1);
+	for(int i=0;i<density_fft_size;i++)
+		density_fft_buffer[i] *= density_kernel[i];
+	fft(density_fft_buffer,density_fft_size,1);
+	
+	for(int i=0;i<density_bins;i++)
+	{
+		double density = density_fft_buffer[i].real()/density_fft_size;
+		density_accumulator[i] += density;
+		density_square_accumulator[i] += density*density;
+		density_histogram[i] = 0;
+	}
+}
+
+// The transform of the gaussian kernel, sampled on the grid (negative distances wrap around) and normalized.
+void setupDensityKernel()
+{
+	double delta_pos = (histogram_end-histogram_start)/density_bins;
+	double normalization = 0;
+	for(int i=0;i<density_fft_size;i++)
+	{
+		int distance = i;
+		if(i>density_fft_size/2)
+			distance = i-density_fft_size;
+		double u = distance*delta_pos/density_bandwidth;
+		density_kernel[i] = exp(-u*u/2);
+		normalization += density_kernel[i].real();
+	}
+	for(int i=0;i<density_fft_size;i++)
+		density_kernel[i] /= normalization;
+	fft(density_kernel,density_fft_size,-1);
+}
+
+void startPipeline()
+{
+	pipeline = new pipelineWorker[pipeline_threads];
+	pipeline_stop = false;
+	pipeline_next = 0;
+	for(int w=0;w<pipeline_threads;w++)
+	{
+		pipelineWorker& worker = pipeline[w];
+		worker.slots = new double[pipeline_slots*(timeslices+2)];
+		worker.head = 0;
+		worker.tail = 0;
+		worker.potential_energy = new double[timeslices]();
+		worker.kinetic_energy = new double[timeslices]();
+		worker.positions_histogram = new double[histogram_bins]();
+		worker.density_histogram = new double[density_bins]();
+		worker.correlation = new double[correlation_lags]();
+		worker.fft_buffer = new complex<double>[correlation_fft_size];
+		worker.measurements = 0;
+		worker.waiting = 0;
+	}
+	for(int w=0;w<pipeline_threads;w++)
+		pipeline[w].thread = thread(pipelineWork, w);
+}
+
+// Sleeps until ready() is true. ready() reads the atomics of the ring, that the other side changes before pipelineNotify()
+template<typename Condition> void pipelineWait(pipelineWorker& worker, Condition ready)
+{
+	if(ready())
+		return;
+	unique_lock<mutex> lock(worker.mutex);
+	worker.waiting++;
+	worker.changed.wait(lock, ready);
+	worker.waiting--;
+}
+
+// Wakes the side sleeping on the ring, if any: called after head, tail or pipeline_stop have changed
+void pipelineNotify(pipelineWorker& worker)
+{
+	if(worker.waiting.load()==0)
+		return;
+	{
+		lock_guard<mutex> lock(worker.mutex);
+	}
+	worker.changed.notify_all();
+}
+
+void publishSnapshot()
+{
+	pipelineWorker& worker = pipeline[pipeline_next];
+	pipeline_next = (pipeline_next+1)%pipeline_threads;
+	
+	long head = worker.head.load(memory_order_relaxed);
+	pipelineWait(worker, [&]{ return head-worker.tail.load()<pipeline_slots; });  // the ring is full
+	
+	double* snapshot = worker.slots+(head%pipeline_slots)*(timeslices+2);
+	for(int i=0;i<timeslices;i++)
+		snapshot[i] = positions[i];
+	snapshot[timeslices] = local_energy_left;
+	snapshot[timeslices+1] = local_energy_right;
+	worker.head.store(head+1);
+	pipelineNotify(worker);
+}
+
+void pipelineWork(int w)
+{
+	pipelineWorker& worker = pipeline[w];
+	long tail = worker.tail.load(memory_order_relaxed);
+	while(true)
+	{
+		pipelineWait(worker, [&]{ return tail!=worker.head.load() || pipeline_stop.load(); });
+		if(tail==worker.head.load())  // stopped, and nothing left to measure
+			return;
+		measureSnapshot(worker.slots+(tail%pipeline_slots)*(timeslices+2), worker);
+		tail++;
+		worker.tail.store(tail);
+		pipelineNotify(worker);
+	}
+}
+
+// The same estimators of upgradeAverages/beadsChanged, evaluated from scratch on a snapshot.
+void measureSnapshot(const double* x, pipelineWorker& worker)
+{
+	for(int i=0;i<timeslices;i++)
+	{
+		worker.potential_energy[i] += external_potential(x[i]);
+		if(PIGS && i==0)
+			worker.kinetic_energy[i] += x[timeslices];
+		else if(PIGS && i==timeslices-1)
+			worker.kinetic_energy[i] += x[timeslices+1];
+		else
+			worker.kinetic_energy[i] += kineticEstimator(x[i],x[index_mask(i+1)]);
+	}
+	
+	for(int i=timeslices_averages_start;i<=timeslices_averages_end;i++)
+	{
+		worker.positions_histogram[histogramBin(x[i])] += 1;
+		int k = densityBin(x[i]);
+		if(k>=0)
+			worker.density_histogram[k] += 1;
+	}
+	
+	if(correlation_function)
+		correlationEstimator(x, worker.correlation, worker.fft_buffer);
+	
+	worker.measurements++;
+}
+
+void collectPipeline()
+{
+	measurements = 0;
+	for(int w=0;w<pipeline_threads;w++)
+	{
+		pipelineWorker& worker = pipeline[w];
+		pipelineWait(worker, [&]{ return worker.tail.load()==worker.head.load(); });
+		
+		for(int i=0;i<timeslices;i++)
+		{
+			potential_energy[i] += worker.potential_energy[i];
+			kinetic_energy[i] += worker.kinetic_energy[i];
+			worker.potential_energy[i] = 0;
+			worker.kinetic_energy[i] = 0;
+		}
+		for(int i=0;i<histogram_bins;i++)
+		{
+			positions_histogram[i] += worker.positions_histogram[i];
+			worker.positions_histogram[i] = 0;
+		}
+		for(int i=0;i<density_bins;i++)
+		{
+			density_histogram[i] += worker.density_histogram[i];
+			worker.density_histogram[i] = 0;
+		}
+		for(int i=0;i<correlation_lags;i++)
+		{
+			correlation[i] += worker.correlation[i];
+			worker.correlation[i] = 0;
+		}
+		measurements += worker.measurements;
+		worker.measurements = 0;
+	}
+}
+
+void stopPipeline()
+{
+	pipeline_stop.store(true);
+	for(int w=0;w<pipeline_threads;w++)
+	{
+		pipelineWorker& worker = pipeline[w];
+		pipelineNotify(worker);
+		worker.thread.join();
+		delete [] worker.slots;
+		delete [] worker.potential_energy;
+		delete [] worker.kinetic_energy;
+		delete [] worker.positions_histogram;
+		delete [] worker.density_histogram;
+		delete [] worker.correlation;
+		delete [] worker.fft_buffer;
+	}
+	delete [] pipeline;
+}
+
+/*
+trajectory.bin starts with a header of 64 bytes:
+	0  char[8] "QMC1DTRJ"        24 double dtau
+	8  int32 version (2)         32 double trajectory_quantum
+	12 int32 timeslices          40 int32 PIGS
+	16 int32 trajectory_encoding 44 int32 byte order mark (1)
+	20 int32 trajectory_stride   48 int64 number of frames (written at the end)
+followed by frames of fixed size, so that the file can be memory-mapped (see trajectory.py).
+Everything is written in the byte order of the host: the reader finds it from the byte order
+mark (version 1 files have 0 there and are little endian).
+Returns false, with trajectory_stride set to 0, if trajectory.bin can't be opened.
+*/
+bool startTrajectory()
+{
+	trajectory_file.open("trajectory.bin", ios::binary);
+	if(!trajectory_file.is_open())
+	{
+		cerr<<"Unable to open trajectory.bin"<<endl;
+		trajectory_stride = 0;
+		return false;
+	}
+	
+	if(trajectory_encoding)
+		trajectory_frame_size = sizeof(int32_t)+(timeslices-1)*sizeof(int16_t);
+	else
+		trajectory_frame_size = timeslices*sizeof(float);
+	
+	char header[64] = "QMC1DTRJ";
+	int32_t version = 2;
+	int32_t header_ints[4] = {version, timeslices, trajectory_encoding, trajectory_stride};
+	int32_t pigs = PIGS, byte_order = 1;
+	memcpy(header+8, header_ints, sizeof(header_ints));
+	memcpy(header+24, &dtau, sizeof(double));
+	memcpy(header+32, &trajectory_quantum, sizeof(double));
+	memcpy(header+40, &pigs, sizeof(int32_t));
+	memcpy(header+44, &byte_order, sizeof(int32_t));
+	trajectory_file.write(header, 64);
+	
+	for(int b=0;b<2;b++)
+		trajectory_buffer[b] = new char[trajectory_buffer_frames*trajectory_frame_size];
+	trajectory_steps = 0;
+	trajectory_frames = 0;
+	trajectory_current = 0;
+	trajectory_fill = 0;
+	trajectory_pending = 0;
+	trajectory_stop = false;
+	trajectory_writer = thread(trajectoryWork);
+	return true;
+}
+
+/*
+The delta encoding keeps the sum of the written differences (reconstructed) instead of the
+quantized previous bead: a difference that doesn't fit in an int16 is clipped and the error is
+recovered on the following beads, so it never accumulates along the polymer.
+*/
+void recordTrajectory()
+{
+	char* frame = trajectory_buffer[trajectory_current]+trajectory_fill*trajectory_frame_size;
+	if(trajectory_encoding)
+	{
+		int32_t first = (int32_t)lround(positions[0]/trajectory_quantum);
+		memcpy(frame, &first, sizeof(int32_t));
+		int16_t* deltas = (int16_t*)(frame+sizeof(int32_t));
+		long reconstructed = first;
+		for(int i=1;i<timeslices;i++)
+		{
+			long delta = lround(positions[i]/trajectory_quantum)-reconstructed;
+			delta = max(-32768L, min(32767L, delta));
+			deltas[i-1] = (int16_t)delta;
+			reconstructed += delta;
+		}
+	}
+	else
+	{
+		float* values = (float*)frame;
+		for(int i=0;i<timeslices;i++)
+			values[i] = (float)positions[i];
+	}
+	
+	trajectory_fill++;
+	trajectory_frames++;
+	if(trajectory_fill==trajectory_buffer_frames)
+		flushTrajectory();
+}
+
+// hands the current buffer to the writer, after it has finished with the other one
+void flushTrajectory()
+{
+	unique_lock<mutex> lock(trajectory_mutex);
+	trajectory_signal.wait(lock, []{ return trajectory_pending==0; });
+	trajectory_pending = trajectory_fill;
+	trajectory_current = 1-trajectory_current;
+	trajectory_fill = 0;
+	lock.unlock();
+	trajectory_signal.notify_all();
+}
+
+void trajectoryWork()
+{
+	unique_lock<mutex> lock(trajectory_mutex);
+	while(true)
+	{
+		trajectory_signal.wait(lock, []{ return trajectory_pending>0 || trajectory_stop; });
+		if(trajectory_pending==0)
+			break;
+		const char* buffer = trajectory_buffer[1-trajectory_current];  // the sampler already moved to the other one
+		int frames = trajectory_pending;
+		lock.unlock();
+		trajectory_file.write(buffer, (long)frames*trajectory_frame_size);
+		lock.lock();
+		trajectory_pending = 0;
+		trajectory_signal.notify_all();
+	}
+}
+
+void stopTrajectory()
+{
+	if(trajectory_fill)
+		flushTrajectory();
+	{
+		unique_lock<mutex> lock(trajectory_mutex);
+		trajectory_stop = true;
+	}
+	trajectory_signal.notify_all();
+	trajectory_writer.join();
+	
+	int64_t frames = trajectory_frames;
+	trajectory_file.seekp(48);
+	trajectory_file.write((const char*)&frames, sizeof(int64_t));
+	trajectory_file.close();
+	for(int b=0;b<2;b++)
+		delete [] trajectory_buffer[b];
+}
+
+/*
+finalize**** functions write the averages over the blocks and their errors (see blockAverage()).
+*/
+void finalizePotentialEstimator()
+{
+	ofstream out("potential.dat");
+	double* average = new double[timeslices];
+	double* error = new double[timeslices];
+	qmc1d_potential(average, error);
+	for(int i=0;i<timeslices;i++)
+		out<<i<<" "<<average[i]<<" "<<error[i]<<endl;
+	out.close();
+	delete [] average;
+	delete [] error;
+}
+
+void finalizeKineticEstimator()
+{
+	ofstream out("kinetic.dat");
+	double* average = new double[timeslices];
+	double* error = new double[timeslices];
+	qmc1d_kinetic(average, error);
+	for(int i=0;i<timeslices;i++)
+		out<<i<<" "<<average[i]<<" "<<error[i]<<endl;
+	out.close();
+	delete [] average;
+	delete [] error;
+}
+
+void finalizeHistogram()
+{
+	ofstream out("probability.dat");
+	double* position = new double[histogram_bins];
+	double* average = new double[histogram_bins];
+	double* error = new double[histogram_bins];
+	qmc1d_histogram(position, average, error);
+	for(int i=0; i<histogram_bins; i++)
+		out << position[i] << " " << average[i] << " " << error[i] << endl;
+	out.close();
+	delete [] position;
+	delete [] average;
+	delete [] error;
+}
+
+void finalizeCorrelation()
+{
+	ofstream out("correlation.dat");
+	double* tau = new double[correlation_lags];
+	double* average = new double[correlation_lags];
+	double* error = new double[correlation_lags];
+	qmc1d_correlation(tau, average, error);
+	for(int i=0;i<correlation_lags;i++)
+		out<<tau[i]<<" "<<average[i]<<" "<<error[i]<<endl;
+	out.close();
+	delete [] tau;
+	delete [] average;
+	delete [] error;
+}
+
+void finalizeDensity()
+{
+	ofstream out("density.dat");
+	double* position = new double[density_bins];
+	double* average = new double[density_bins];
+	double* error = new double[density_bins];
+	qmc1d_density(position, average, error);
+	for(int i=0;i<density_bins;i++)
+		out<<position[i]<<" "<<average[i]<<" "<<error[i]<<endl;
+	out.close();
+	delete [] position;
+	delete [] average;
+	delete [] error;
+}
+
+// (-hbar*hbar/2m)d^2/dx^2G(x,x',dtau)
+double kineticEstimator(double value,double next_value)
+{
+	double kinetic_prime = (value-next_value)/(2*lambda*dtau);
+	double kinetic_second= 1./(2*lambda*dtau);
+	double term_1 = (dtau/2)*external_potential_prime(value)+kinetic_prime;
+	double term_2 = (dtau/2)*external_potential_second(value)+kinetic_second;
+	return -(hbar*hbar/(2*mass))*(term_1*term_1 - term_2);
+}
+
+// (-hbar*hbar/2m)(d^2/dx^2 psi)/psi, written explicitly so that it costs a single tanh
+double variationalLocalEnergy(double val)
+{
+	if(trial_wavefunction)  // the tabulated trial function is an eigenstate: E_L = E0
+		return trial_energy-external_potential(val);
+	
+	double s2 = sigma_wf * sigma_wf;
+	double compl_term = 2 * val * mu_wf * tanh(val * mu_wf/s2);
+	return (hbar*hbar/(2*mass))*(s2 - mu_wf * mu_wf - val * val + compl_term)/(s2 * s2);
+}
+
+void setParameters(const qmc1d_params* params)
+{
+	timeslices = params->timeslices;
+	temperature = params->temperature;
+	imaginaryTimePropagation = params->imaginaryTimePropagation;
+	brownianMotionReconstructions = params->brownianMotionReconstructions;
+	delta_translation = params->delta_translation;
+	brownianBridgeReconstructions = params->brownianBridgeReconstructions;
+	brownianBridgeAttempts = params->brownianBridgeAttempts;
+	MCSTEPS = params->MCSTEPS;
+	equilibration = params->equilibration;
+	blocks = params->blocks;
+	measurement_interval = params->measurement_interval;
+	histogram_bins = params->histogram_bins;
+	histogram_start = params->histogram_start;
+	histogram_end = params->histogram_end;
+	density_bins = params->density_bins;
+	density_bandwidth = params->density_bandwidth;
+	timeslices_averages_start = params->timeslices_averages_start;
+	timeslices_averages_end = params->timeslices_averages_end;
+	correlation_function = params->correlation_function;
+	pipeline_threads = params->pipeline_threads;
+	pipeline_slots = params->pipeline_slots;
+	bridge_threads = params->bridge_threads;
+	bridge_domain_length = params->bridge_domain_length;
+	hmc_attempts = params->hmc_attempts;
+	hmc_steps = params->hmc_steps;
+	hmc_stepsize = params->hmc_stepsize;
+	hmc_normal_modes = params->hmc_normal_modes;
+	coarse_timeslices = params->coarse_timeslices;
+	coarse_steps = params->coarse_steps;
+	pair_action_points = params->pair_action_points;
+	pair_action_extent = params->pair_action_extent;
+	pair_action_squarings = params->pair_action_squarings;
+	trial_wavefunction = params->trial_wavefunction;
+	trial_points = params->trial_points;
+	trial_extent = params->trial_extent;
+	trajectory_stride = params->trajectory_stride;
+	trajectory_encoding = params->trajectory_encoding;
+	trajectory_quantum = params->trajectory_quantum;
+	seed = params->seed;
+}
+
+void deleteMemory()
+{
+	delete [] positions;
+	delete [] potential_energy;
+	delete [] potential_energy_accumulator;
+	delete [] potential_energy_square_accumulator;
+                                                                                                                 
+	delete [] kinetic_energy;
+	delete [] kinetic_energy_accumulator;
+	delete [] kinetic_energy_square_accumulator;
+                                                                                                                 
+	delete [] positions_histogram;
+	delete [] positions_histogram_accumulator;
+	delete [] positions_histogram_square_accumulator;
+
+	delete [] potential_current;
+	delete [] kinetic_current;
+	delete [] histogram_bin;
+	delete [] density_bin;
+	if(density_bins)
+	{
+		delete [] density_histogram;
+		delete [] density_accumulator;
+		delete [] density_square_accumulator;
+		delete [] density_kernel;
+		delete [] density_fft_buffer;
+	}
+	delete [] last_measurement;
+
+	delete [] correlation;
+	delete [] correlation_accumulator;
+	delete [] correlation_square_accumulator;
+	delete [] correlation_fft_buffer;
+
+	if(pair_action_points)
+		delete [] pair_action_table;
+	if(trial_wavefunction)
+		delete [] trial_log_psi;
+	
+	if(hmc_attempts)
+	{
+		delete [] hmc_positions;
+		delete [] hmc_momenta;
+		delete [] hmc_velocities;
+		delete [] hmc_forces;
+		delete [] hmc_mass_diagonal;
+		delete [] hmc_mass_subdiagonal;
+		delete [] hmc_mass_last_row;
+	}
+	
+	if(bridge_threads)
+	{
+		{
+			lock_guard<mutex> lock(bridge_mutex);
+			bridge_stop = true;
+		}
+		bridge_start.notify_all();
+		for(int t=1;t<bridge_threads;t++)
+			bridge_pool[t].join();
+		delete [] bridge_pool;
+		delete [] bridge_domain_start;
+		delete [] bridge_domain_links;
+		delete [] bridge_domain_accepted;
+		delete [] bridge_domain_total;
+	}
+}
+
+/****************************************************************
+*****************************************************************
+    _/    _/  _/_/_/  _/       Numerical Simulation Laboratory
+   _/_/  _/ _/       _/       Physics Department
+  _/  _/_/    _/    _/       Universita' degli Studi di Milano
+ _/    _/       _/ _/       Prof. D.E. Galli
+_/    _/  _/_/_/  _/_/_/_/ email: Davide.Galli@unimi.it
+*****************************************************************
+*****************************************************************/
@@ -0,0 +1,75 @@
+"""
+Reader of trajectory.bin, the polymer configurations written by qmc1d (see startTrajectory()
+in qmc1d_lib.cpp). The file is memory-mapped: only the frames that are accessed are read.
+It is written in the byte order of the machine that ran qmc1d, recorded in the header.
+
+    import trajectory
+    traj = trajectory.load("trajectory.bin")
+    len(traj), traj.timeslices, traj.dtau
+    polymer = traj[100]         # positions of the beads in the 100th frame
+    polymers = traj[::10]       # (frames, timeslices) array
+"""
+import os
+import numpy as np
+
+
+def header_dtype(order):
+    return np.dtype([("magic", "S8"), ("version", order + "i4"), ("timeslices", order + "i4"),
+                     ("encoding", order + "i4"), ("stride", order + "i4"), ("dtau", order + "f8"),
+                     ("quantum", order + "f8"), ("pigs", order + "i4"), ("byte_order", order + "i4"),
+                     ("frames", order + "i8"), ("padding", order + "i8")])
+
+
+def byte_order(filename):
+    """"<" or ">": the byte order mark is 1 in the order of the writer, 0 in version 1 files (little endian)."""
+    with open(filename, "rb") as f:
+        mark = f.read(48)[44:48]
+    if mark in (b"\x01\x00\x00\x00", b"\x00\x00\x00\x00"):
+        return "<"
+    if mark == b"\x00\x00\x00\x01":
+        return ">"
+    raise ValueError(filename + ": unknown byte order mark")
+
+
+class Trajectory:
+    def __init__(self, filename):
+        order = byte_order(filename)
+        header_type = header_dtype(order)
+        header = np.fromfile(filename, dtype=header_type, count=1)[0]
+        if header["magic"] != b"QMC1DTRJ":
+            raise ValueError(filename + " is not a qmc1d trajectory")
+        self.timeslices = int(header["timeslices"])
+        self.encoding = int(header["encoding"])
+        self.stride = int(header["stride"])
+        self.dtau = float(header["dtau"])
+        self.quantum = float(header["quantum"])
+        self.pigs = bool(header["pigs"])
+
+        if self.encoding:
+            frame = np.dtype([("first", order + "i4"), ("deltas", order + "i2", (self.timeslices - 1,))])
+        else:
+            frame = np.dtype((order + "f4", (self.timeslices,)))
+        # the number of frames in the header is written at the end of the run: the size of the
+        # file is used instead, so that a trajectory can be read while qmc1d is still running
+        count = (os.path.getsize(filename) - header_type.itemsize) // frame.itemsize
+        self.frames = np.memmap(filename, dtype=frame, mode="r", offset=header_type.itemsize, shape=(count,))
+
+    def __len__(self):
+        return len(self.frames)
+
+    def __getitem__(self, index):
+        frames = self.frames[index]
+        if not self.encoding:
+            return np.asarray(frames, dtype=np.float64)
+        first = np.asarray(frames["first"], dtype=np.int64)[..., None]
+        deltas = np.asarray(frames["deltas"], dtype=np.int64)
+        quantized = np.concatenate([first, first + np.cumsum(deltas, axis=-1)], axis=-1)
+        return quantized * self.quantum
+
+    def times(self):
+        """The imaginary times of the beads."""
+        return np.arange(self.timeslices) * self.dtau
+
+
+def load(filename="trajectory.bin"):
+    return Trajectory(filename)
@@ -0,0 +1,95 @@
+#ifndef __Philox__
+#define __Philox__
+
+#include <cstdint>
+#include <cmath>
+
+/*
+Philox4x32-10 counter-based generator (Salmon et al., SC11): the random numbers are a keyed
+bijection of a 128 bit counter, so the numbers of a move depend only on the key and on the
+counter chosen for that move, and not on the order in which the moves are made or on the
+thread that makes them. Philox holds only the key, so it can be shared by any number of threads;
+the numbers are drawn through a PhiloxStream, a small object that lives on the stack of the move.
+The key is (seed, replica), the counter (step, move, index): index is advanced by the stream.
+*/
+class PhiloxStream;
+
+class Philox {
+
+private:
+  uint32_t k0, k1;
+
+public:
+  // Default constructor
+  Philox(uint32_t seed = 0, uint32_t replica = 0) : k0(seed), k1(replica) {}
+  // One round of Philox4x32, the key is bumped after it
+  static inline void Round(uint32_t& x0, uint32_t& x1, uint32_t& x2, uint32_t& x3, uint32_t& key0, uint32_t& key1) {
+    uint64_t p0 = (uint64_t)0xD2511F53u * x0;
+    uint64_t p1 = (uint64_t)0xCD9E8D57u * x2;
+    uint32_t y0 = (uint32_t)(p1 >> 32) ^ x1 ^ key0;
+    uint32_t y2 = (uint32_t)(p0 >> 32) ^ x3 ^ key1;
+    x0 = y0; x1 = (uint32_t)p1; x2 = y2; x3 = (uint32_t)p0;
+    key0 += 0x9E3779B9u; key1 += 0xBB67AE85u;
+  }
+  // Method to encrypt the counter (c0, c1, c2, c3) into the four random words r0..r3. The ten rounds
+  // are written out and the words are passed one by one, so that a loop over many counters is vectorized
+  void Block(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t& r0, uint32_t& r1, uint32_t& r2, uint32_t& r3) const {
+    uint32_t key0 = k0, key1 = k1;
+    Round(c0, c1, c2, c3, key0, key1); Round(c0, c1, c2, c3, key0, key1);
+    Round(c0, c1, c2, c3, key0, key1); Round(c0, c1, c2, c3, key0, key1);
+    Round(c0, c1, c2, c3, key0, key1); Round(c0, c1, c2, c3, key0, key1);
+    Round(c0, c1, c2, c3, key0, key1); Round(c0, c1, c2, c3, key0, key1);
+    Round(c0, c1, c2, c3, key0, key1); Round(c0, c1, c2, c3, key0, key1);
+    r0 = c0; r1 = c1; r2 = c2; r3 = c3;
+  }
+  // Method to encrypt the counter c into the four random words r
+  void Block(const uint32_t c[4], uint32_t r[4]) const { Block(c[0], c[1], c[2], c[3], r[0], r[1], r[2], r[3]); }
+  // Method to open the stream of the move "move" of the step "step"
+  PhiloxStream Stream(uint64_t step, uint32_t move) const;
+};
+
+// The random numbers of one (step, move): its methods have the names of Random and of TRandom3
+class PhiloxStream {
+
+private:
+  const Philox* philox;
+  uint32_t counter[4];
+  uint32_t block[4];
+  int used;
+
+  uint32_t Next() {
+    if(used == 4){
+      philox->Block(counter, block);
+      counter[3]++;
+      used = 0;
+    }
+    return block[used++];
+  }
+
+public:
+  PhiloxStream(const Philox* generator, uint64_t step, uint32_t move) : philox(generator), used(4) {
+    counter[0] = (uint32_t)step; counter[1] = (uint32_t)(step >> 32); counter[2] = move; counter[3] = 0;
+  }
+  // Method to generate a random number in the range [0,1), with 53 random bits
+  double Rannyu(void) {
+    uint32_t a = Next() >> 5, b = Next() >> 6;
+    return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+  }
+  // Method to generate a random number in the range [min,max)
+  double Rannyu(double min, double max) { return min + (max - min) * Rannyu(); }
+  // Method to generate a random number with a Gaussian distribution (Box-Muller)
+  double Gauss(double mean, double sigma) {
+    double s = Rannyu();
+    double t = Rannyu();
+    return mean + sigma * sqrt(-2. * log(1. - s)) * cos(2. * M_PI * t);
+  }
+  double Rndm(void) { return Rannyu(); }
+  double Uniform(double min, double max) { return Rannyu(min, max); }
+  double Gaus(double mean, double sigma) { return Gauss(mean, sigma); }
+};
+
+inline PhiloxStream Philox::Stream(uint64_t step, uint32_t move) const {
+  return PhiloxStream(this, step, move);
+}
+
+#endif // __Philox__
@@ -2,54 +2,32 @@
 
 
 
-//Funzione per inizializzazione di elemento di tipo Random
-void init(Random& rnd) {
+//Funzione per inizializzazione di elemento di tipo Random: la coppia di primi è quella della
+//riga "stream" di Primes, così generatori con stream diversi danno sequenze indipendenti.
+//Senza primi o seme il generatore non sarebbe inizializzato, quindi il programma si ferma
+void init(Random& rnd, int stream) {
     
     int seed[4];
     int p1, p2;
-    ifstream Primes("../RANDOM_GEN/Primes");
+    ifstream Primes("../RandomGen/Primes");
     if (Primes.is_open()){
-        Primes >> p1 >> p2 ;
-    } else cerr << "PROBLEM: Unable to open Primes" << endl;
+        for(int i=0; i<=stream; i++) { Primes >> p1 >> p2 ; }
+        if(!Primes) { cerr << "PROBLEM: Primes has no line " << stream + 1 << endl; exit(1); }
+    } else { cerr << "PROBLEM: Unable to open Primes" << endl; exit(1); }
     Primes.close();
 
-    ifstream input("../RANDOM_GEN/seed.in");
+    ifstream input("../RandomGen/seed.in");
     string property;
+    bool seme = false;
     if (input.is_open()){
-        while ( !input.eof() ){
-            input >> property;
+        while ( input >> property ){
             if( property == "RANDOMSEED" ){
                 input >> seed[0] >> seed[1] >> seed[2] >> seed[3];
-                rnd.SetRandom(seed,p1,p2);
+                if(input) { rnd.SetRandom(seed,p1,p2); seme = true; }
             }
         }
         input.close();
-    } else cerr << "PROBLEM: Unable to open seed.in" << endl;
+    } else { cerr << "PROBLEM: Unable to open seed.in" << endl; exit(1); }
+    if(!seme) { cerr << "PROBLEM: seed.in has no RANDOMSEED line" << endl; exit(1); }
 
 }
-
-
-
-//Funzione per calcolo del modulo quadro
-double mod2(double x, double sigma, double mu) {
-    double appo = 0;
-
-    //Valore della funzione d'onda nel punto x considerato
-    appo = exp(-pow(x-mu, 2)/(2 * pow(sigma, 2))) + exp(-pow(x+mu, 2)/(2 * pow(sigma, 2)));
-
-    //Restituisco il valore del quadrato della funzione d'onda
-    return appo*appo;
-}
-
-
-
-//Integranda
-double integranda(double x, double sigma, double mu) {
-
-    double appo = 0;
-
-    //Effettuo il calcolo
-    appo = (pow(sigma, 2) - pow(mu, 2) - pow(x, 2) + 2*x*mu*tanh(x*mu/pow(sigma, 2)))/(2*pow(sigma, 4)) + pow(x, 4) - 2.5 * pow(x, 2);
-
-    return appo;
-}
\ No newline at end of file
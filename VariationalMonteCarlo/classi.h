@@ -5,67 +5,113 @@
 #include <fstream>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <mutex>
+#include <condition_variable>
 
 #include "random.h"
+#include "philox.h"
+#include "funzioni_onda.h"
 
 using namespace std;
 
-//Funzione per inizializzazione di elemento di tipo Random
-void init(Random& rnd);
-//Funzione per calcolo del modulo quadro
-double mod2(double x, double sigma, double mu);
-//Integranda
-double integranda(double x, double sigma, double mu);
+//Funzione per inizializzazione di elemento di tipo Random (stream = riga di Primes da usare)
+void init(Random& rnd, int stream = 0);
 
 
 
 
-//Classe per modulo quadro funzione d'onda
+//Classe per modulo quadro funzione d'onda (Psi: funzione d'onda di prova, vedi funzioni_onda.h)
+template<class Psi>
 class var_Mod2{
 
     public:
-    //Costruttore di default
-    var_Mod2(double mu, double sigma, double delta) { init(rnd); m_mu = mu; m_sigma = sigma; m_delta = delta; }
+    //Costruttore di default (stream sceglie la sequenza di numeri casuali, vedi init)
+    var_Mod2(const Psi& psi, double delta, int stream = 0) { init(rnd, stream); m_psi = psi; m_delta = delta; m_accettazione = 0; m_stato = 0; }
     //Distruttore
     ~var_Mod2() {;}
 
 
     //Metodi Get
-    double Get_mu() { return m_mu; }
-    double Get_sigma() { return m_sigma; }
-    double Get_delta() { return m_delta; }
+    const Psi& Get_psi() { return m_psi; }
+    double Get_par(int k) { return m_psi.Get_par(k); }
+    double Get_delta() { return m_delta; }    //Con l'adattamento acceso è l'ultimo delta scelto da Adatta
+    double Get_accettazione() { return m_accettazione; }
 
-    //Metodi Set
-    void Set_mu(double mu) { m_mu = mu; }
-    void Set_sigma(double sigma) { m_sigma = sigma; }
+    //Metodi Set (cambiare i parametri invalida lo stato salvato)
+    void Set_par(int k, double p) { m_psi.Set_par(k, p); m_stato = 0; }
     void Set_delta(double delta) { m_delta = delta; }
+    void Set_accettazione(double acc) { m_accettazione = acc; }     //Accettazione obiettivo di Adatta (0 delta fisso)
+
 
-    
     //Metodo move per campionare il modulo quadro della funzione d'onda
     int Move(double& x) {
 
         /*********************************************************************************
         *    Noto che il parametro x è la vecchia posizione, per determinare la nuova    *
-        *    devo proporre una move lavorando con il parametro delta.                    *
+        *    devo proporre una move lavorando con il parametro delta. Il logaritmo del   *
+        *    modulo quadro in x è già noto dalla move precedente (m_logp), quindi ne     *
+        *    calcolo solo uno, e confronto nel logaritmo: log(u) < log(p_new/p_old).     *
+        *    Energia locale e derivate vengono dalla stessa exp del modulo quadro        *
+        *    (Completo), così un punto accettato non va più rivalutato.                  *
         *********************************************************************************/
 
         double x_new = 0;    //Nuova posizione
-        double prob = 0;     //Probabilità di movimento
+        double logp_new = 0, eloc_new = 0, d1 = 0, o_new[Psi::n_par];    //Stato nella nuova posizione
 
+        Stato(x);
         x_new = x + (rnd.Rannyu() - 0.5) * m_delta;    //Determino nuova posizione
-        prob = mod2(x_new, m_sigma, m_mu)/mod2(x, m_sigma, m_mu);
+        m_psi.Completo(x_new, logp_new, eloc_new, d1, o_new);
 
-        if(rnd.Rannyu() < prob){ //Effettuo il passo
-            x = x_new; 
-            return 1; 
-        } 
+        if(log(rnd.Rannyu()) < logp_new - m_logp){ //Effettuo il passo
+            x = x_new;
+            m_x = x_new; m_logp = logp_new; m_eloc = eloc_new;
+            for(int k=0; k<Psi::n_par; k++) { m_o[k] = o_new[k]; }
+            return 1;
+        }
 
         return 0; //Non effettuo il passo
     }
 
+    //Metodo per termalizzare con "passi" move adattando delta: alla fine della k-esima finestra
+    //di 50 move delta viene moltiplicato per (accettazione misurata/obiettivo)^(1/k), con il
+    //rapporto fra 1/2 e 2, così le correzioni si smorzano e il rumore delle finestre non si accumula
+    void Adatta(double& x, int passi) {
+        const int finestra = 50;
+        for(int i=0, k=1; i<passi; i+=finestra, k++) {
+            int n = min(finestra, passi - i), acce = 0;
+            for(int j=0; j<n; j++) { acce += Move(x); }
+            m_delta *= pow(min(2., max(0.5, (double)acce/(n * m_accettazione))), 1./k);
+        }
+    }
+
+    //Energia locale e derivate logaritmiche rispetto ai parametri in x: se x non è cambiato
+    //dall'ultima move le ho già
+    double LogMod2(double x) { Stato(x); return m_logp; }
+    double Eloc(double x) { Stato(x); return m_eloc; }
+    const double* Derivate(double x) { Stato(x); return m_o; }
+
     protected:
     Random rnd;
-    double m_mu, m_sigma, m_delta;
+    Psi m_psi;
+    double m_delta;
+    double m_accettazione;  //Accettazione obiettivo per l'adattamento di delta
+    double m_x, m_logp, m_eloc;     //Stato salvato: posizione, log del modulo quadro ed energia locale
+    double m_o[Psi::n_par];     //e derivate logaritmiche in m_x
+    int m_stato;    //Validità dello stato salvato
+
+    //Aggiorna lo stato salvato se x non è la posizione a cui si riferisce
+    void Stato(double x) {
+        if(!m_stato || x != m_x){
+            double d1;
+            m_x = x; m_psi.Completo(x, m_logp, m_eloc, d1, m_o);
+            m_stato = 1;
+        }
+    }
 
 };
 
@@ -73,32 +119,46 @@ class var_Mod2{
 
 
 
+template<class Psi>
 class asp_H{
 
     public:
+    static const int n_par = Psi::n_par;
+
     //Costruttore di default
-    asp_H() { n_blk = 0; dim_blk = 0; m_int = 0; m_error = 0; }
-    //Costruttore (parametri dimensione blocco e numero blocchi)
-    asp_H(double num, double dim) { n_blk = num; dim_blk = dim; m_int = 0; m_error = 0; }
+    asp_H() { n_blk = 0; dim_blk = 0; n_term = 0; m_int = 0; m_error = 0; m_derivate = 0; m_walker = 0; }
+    //Costruttore (parametri numero blocchi, dimensione blocco e passi di termalizzazione)
+    asp_H(double num, double dim, int term = 0) { n_blk = num; dim_blk = dim; n_term = term; m_int = 0; m_error = 0; m_derivate = 0; m_walker = 0; }
     //Distruttore
-    ~asp_H() {;}
+    virtual ~asp_H() {;}
 
     //Metodi Get
     int Get_nblk() { return n_blk; }
     int Get_dimblk() { return dim_blk; }
+    int Get_nterm() { return n_term; }
+    double Get_walker() { return m_walker; }
     double Get_integrale() { return m_int; }
     double Get_errore() { return m_error; }
+    //Medie su tutti i campioni dell'ultimo integrale (solo con Set_derivate(1)): k, l indici dei parametri di Psi
+    double Get_O(int k) { return m_der[k]; }    //<O_k>, O_k = d log(psi)/d parametro k
+    double Get_EO(int k) { return m_der[n_par + k]; }   //<E_L O_k>
+    double Get_OO(int k, int l) { return m_der[2 * n_par + k * n_par + l]; }  //<O_k O_l>
 
     //Metodi Set
+    void Set_derivate(int derivate) { m_derivate = derivate; }
     void Set_nblk(int blk) { n_blk = blk; }
     void Set_dimblk(int dim) { dim_blk = dim; }
+    void Set_nterm(int term) { n_term = term; }
+    void Set_walker(double x) { m_walker = x; }     //Per ripartire da un punto scelto (es. x = 0)
     void Set_integrale(double inte) { m_int = inte;}
     void Set_errore(double err) { m_error = err;}
 
-    //Metodo per calcolo dell'integrale
-    void Integrale(var_Mod2& val, int stampa) {
+    //Metodo per calcolo dell'integrale (virtuale: ensemble_H lo ridefinisce). Il walker riparte
+    //da dove l'aveva lasciato la chiamata precedente e fa n_term passi prima del primo blocco:
+    //fra due chiamate del SA i parametri cambiano poco e la catena è già quasi all'equilibrio
+    virtual void Integrale(var_Mod2<Psi>& val, int stampa) {
 
-        double x = 0;
+        double x = m_walker;
         double appo = 0;
         double appo2 = 0;
         int acce = 0;
@@ -109,10 +169,13 @@ class asp_H{
         }
 
         m_int = 0; m_error = 0;
+        for(int k=0; k<n_der; k++) { m_der[k] = 0; }
+
+        Termalizza(val, x);
 
         //Ciclo esterno per i blocchi
         for(int i=0; i<n_blk; i++) {
-            
+
             //Riporto a zero variabili riguardanti il singolo blocco
             appo = 0;
             acce = 0;
@@ -121,7 +184,8 @@ class asp_H{
 
             //Ciclo interno per il singolo blocco
             for(int j=0; j<dim_blk; j++) {
-                appo  = appo * j/(j+1) + integranda(x, val.Get_sigma(), val.Get_mu())/(j+1);
+                appo  = appo * j/(j+1) + val.Eloc(x)/(j+1);
+                if(m_derivate) { Accumula(x, val); }
                 acce += val.Move(x);
             }
 
@@ -136,19 +200,19 @@ class asp_H{
                 if(i==0) { m_error = 0; }
                 else { m_error = sqrt((appo2 - pow(m_int, 2))/(i)); }
 
-                fileout << m_int << "   " << m_error << endl;
+                fileout << m_int << "   " << m_error << "\n";
             }
-            
-            
+
+
         }
 
         if(n_blk != 1) { m_error = sqrt((appo2 - pow(m_int, 2))/(n_blk - 1)); } //Associo errore alla stima
-        
+        for(int k=0; k<n_der; k++) { m_der[k] /= (double)n_blk * dim_blk; }
+        m_walker = x;
+
         if(stampa == 1) {
             cout << endl << "--------------------------------------------------------" << endl;
-            cout << endl << endl << "Effettuata stima dell' integrale con: sigma = " << val.Get_sigma() << "   mu = " << val.Get_mu() << endl;
-            cout << "Valore integrale: " << m_int << endl;
-            cout << "Errore integrale: " << m_error << endl << endl << endl;
+            Riepilogo(val);
             fileout.close();
         }
 
@@ -157,8 +221,249 @@ class asp_H{
 
 
     protected:
-    int n_blk, dim_blk;
+    static const int n_der = 2 * n_par + n_par * n_par;     //O_k, E_L O_k, O_k O_l
+    int n_blk, dim_blk, n_term;
     double m_int, m_error;
+    double m_walker;    //Posizione del walker alla fine dell'ultimo integrale
+    int m_derivate;     //Se 1 accumulo le derivate logaritmiche per l'ottimizzazione
+    double m_der[n_der];    //Somme di O_k, E_L O_k e O_k O_l (in quest'ordine)
+
+    //n_term move del walker x prima dei blocchi, adattando delta se val ha un'accettazione obiettivo
+    void Termalizza(var_Mod2<Psi>& val, double& x) {
+        if(val.Get_accettazione() > 0) { val.Adatta(x, n_term); }
+        else { for(int i=0; i<n_term; i++) { val.Move(x); } }
+    }
+
+    //Aggiunge il campione x alle somme delle derivate
+    void Accumula(double x, var_Mod2<Psi>& val) {
+        const double* o = val.Derivate(x);
+        double e = val.Eloc(x);
+        for(int k=0; k<n_par; k++) {
+            m_der[k] += o[k]; m_der[n_par + k] += e * o[k];
+            for(int l=0; l<n_par; l++) { m_der[2 * n_par + k * n_par + l] += o[k] * o[l]; }
+        }
+    }
+
+    //Stampa finale: parametri, delta, integrale ed errore
+    void Riepilogo(var_Mod2<Psi>& val) {
+        cout << endl << endl << "Effettuata stima dell' integrale con:";
+        for(int k=0; k<n_par; k++) { cout << "   " << Psi::Nome(k) << " = " << val.Get_par(k); }
+        cout << endl;
+        cout << "Delta: " << val.Get_delta() << endl;
+        cout << "Valore integrale: " << m_int << endl;
+        cout << "Errore integrale: " << m_error << endl << endl << endl;
+    }
+
+};
+
+
+
+
+
+template<class Psi>
+class ensemble_H : public asp_H<Psi>{
+
+    /*********************************************************************************
+    *    Stesso integrale di asp_H, ma con una popolazione di n_walk walker salvati  *
+    *    in array contigui e fatti avanzare tutti insieme: il ciclo sui walker è     *
+    *    vettorizzato (#pragma omp simd) e i walker sono divisi in gruppi contigui   *
+    *    fra n_thread thread. I numeri casuali vengono da Philox con contatore        *
+    *    (passo, walker), quindi il risultato non dipende dal numero di thread. Ogni  *
+    *    blocco contiene passi * n_walk campioni, con passi = dim_blk/n_walk passi    *
+    *    per walker ma mai meno di passi_min: blocchi più corti sarebbero correlati   *
+    *    fra loro e l'errore sottostimato (avviso a schermo quando succede).          *
+    *    I walker restano dove sono fra una chiamata e l'altra e all'inizio           *
+    *    di ogni chiamata fanno n_term passi di termalizzazione. Con l'adattamento   *
+    *    di delta acceso il delta viene scelto prima da un walker pilota (m_walker). *
+    *    Con le derivate accese ogni walker tiene anche le sue O_k (m_o), calcolate  *
+    *    con Completo insieme a modulo quadro ed energia locale della proposta, e    *
+    *    le somma in m_dw: la somma sui walker è fatta una volta alla fine.          *
+    *********************************************************************************/
+
+    using asp_H<Psi>::n_blk; using asp_H<Psi>::dim_blk; using asp_H<Psi>::n_term; using asp_H<Psi>::m_int;
+    using asp_H<Psi>::m_error; using asp_H<Psi>::m_walker; using asp_H<Psi>::m_derivate; using asp_H<Psi>::m_der;
+    using asp_H<Psi>::n_der;
+
+    public:
+    //Costruttore (parametri numero blocchi, dimensione blocco, walker, passi di termalizzazione e thread)
+    ensemble_H(int num, int dim, int walk, int term, int thread) : asp_H<Psi>(num, dim, term) {
+        n_walk = ((walk + 7)/8) * 8;    //Multiplo di 8 per riempire le lane SIMD
+        n_thread = thread;
+        m_x.assign(n_walk, 0); m_logp.assign(n_walk, 0); m_eloc.assign(n_walk, 0);
+        init(rnd); m_philox = Philox((uint32_t)(rnd.Rannyu() * 4294967296.), 0); m_passo = 0; m_avviso = 0;
+    }
+    //Distruttore
+    ~ensemble_H() {;}
+
+    //Metodi Get
+    int Get_nwalk() { return n_walk; }
+    int Get_nthread() { return n_thread; }
+
+    //Metodi Set
+    void Set_nthread(int thread) { n_thread = thread; }
+
+    //Metodo per calcolo dell'integrale
+    void Integrale(var_Mod2<Psi>& val, int stampa) {
+
+        int passi = dim_blk/n_walk;     //Passi per walker in ogni blocco
+        if(passi < passi_min) {
+            if(m_avviso != dim_blk) {
+                cerr << "ensemble_H: " << dim_blk << " campioni per blocco danno " << passi << " passi per walker, uso " << passi_min
+                     << " passi (" << (long)passi_min * n_walk << " campioni per blocco)" << endl;
+                m_avviso = dim_blk;
+            }
+            passi = passi_min;
+        }
+        vector<double> somme(n_thread * n_blk, 0);   //Somme energia locale di ogni thread in ogni blocco
+        vector<long> acce(n_thread * n_blk, 0);
+        vector<double> der(n_thread * n_der, 0);    //Somme delle derivate di ogni thread
+        if(val.Get_accettazione() > 0) { val.Adatta(m_walker, n_term); }    //Delta uguale per tutti i walker
+        if(m_derivate && m_o.empty()) { m_o.assign(Psi::n_par * n_walk, 0); m_on.assign(Psi::n_par * n_walk, 0); m_dw.assign(n_der * n_walk, 0); }
+
+        //Ogni thread ha un gruppo contiguo di walker (multiplo di 8)
+        vector<thread> gruppi;
+        int lane = (n_walk/8 + n_thread - 1)/n_thread * 8;
+        for(int t=0; t<n_thread; t++) {
+            int w0 = min(t * lane, n_walk), w1 = min((t+1) * lane, n_walk);
+            gruppi.push_back(thread(&ensemble_H::Gruppo, this, w0, w1, passi, val.Get_psi(), val.Get_delta(), &somme[t * n_blk], &acce[t * n_blk], m_derivate ? &der[t * n_der] : nullptr));
+        }
+        for(auto& g : gruppi) { g.join(); }
+        m_passo += n_term + (uint64_t)n_blk * passi;
+        for(int k=0; k<n_der; k++) {
+            m_der[k] = 0;
+            for(int t=0; t<n_thread; t++) { m_der[k] += der[t * n_der + k]; }
+            m_der[k] /= (double)n_blk * passi * n_walk;
+        }
+
+        double appo = 0, appo2 = 0;
+        ofstream fileout;
+        if(stampa == 1){
+            fileout.open("Integrale.dat");
+        }
+
+        m_int = 0; m_error = 0;
+
+        for(int i=0; i<n_blk; i++) {
+            appo = 0; long acc_blk = 0;
+            for(int t=0; t<n_thread; t++) { appo += somme[t * n_blk + i]; acc_blk += acce[t * n_blk + i]; }
+            appo /= (double)passi * n_walk;
+
+            m_int = m_int * i/(i+1) + appo/(i+1);   //Stima integrale post i-esimo blocco
+            appo2 = appo2 * i/(i+1) + appo * appo/(i+1);    //Valore per errore
+
+            if(stampa == 1) {
+                cout << endl << "--------------------------------------------------------" << endl;
+                cout << endl << endl << "Calcolata stima " << i+1 << "-esimo blocco" << endl;
+                cout << "Accettazione: " << (double)acc_blk/((double)passi * n_walk) * 100 << " %" << endl;
+
+                if(i==0) { m_error = 0; }
+                else { m_error = sqrt((appo2 - pow(m_int, 2))/(i)); }
+
+                fileout << m_int << "   " << m_error << "\n";
+            }
+        }
+
+        if(n_blk != 1) { m_error = sqrt((appo2 - pow(m_int, 2))/(n_blk - 1)); } //Associo errore alla stima
+
+        if(stampa == 1) {
+            cout << endl << "--------------------------------------------------------" << endl;
+            this->Riepilogo(val);
+            fileout.close();
+        }
+    }
+
+
+
+    protected:
+    static constexpr int passi_min = 100;   //Passi minimi per walker in un blocco (lunghezza di decorrelazione)
+    int n_walk, n_thread;
+    int m_avviso;   //dim_blk per cui è già stato dato l'avviso su passi_min
+    vector<double> m_x, m_logp, m_eloc;    //Posizioni, log del modulo quadro ed energia locale dei walker
+    vector<double> m_o, m_on;   //Derivate logaritmiche dei walker e delle proposte, m_o[k * n_walk + w]
+    vector<double> m_dw;    //Somme delle derivate (O_k, E_L O_k, O_k O_l) di ogni walker, m_dw[m * n_walk + w]
+    Random rnd; Philox m_philox; uint64_t m_passo;
+
+    //Termalizzazione e blocchi per i walker da w0 a w1 (der: somme delle derivate, nullptr se non servono)
+    void Gruppo(int w0, int w1, int passi, const Psi psi, double delta, double* somme, long* acce, double* der);
+
+};
+
+
+
+
+
+template<class Psi>
+class reweight_H : public asp_H<Psi>{
+
+    /*********************************************************************************
+    *    Correlated sampling: campiono una volta n_blk*dim_blk punti con i parametri *
+    *    di riferimento e stimo l'energia con parametri vicini pesando ogni punto    *
+    *    con w = |psi_new|^2/|psi_rif|^2. Finché la dimensione efficace del campione *
+    *    ESS = (sum w)^2/sum w^2 resta sopra soglia * N ogni integrale costa solo un *
+    *    passaggio sui punti salvati; sotto soglia rifaccio il campione ai nuovi     *
+    *    parametri. Con stampa = 1, soglia <= 0 o con le derivate accese              *
+    *    l'integrale è quello di asp_H.                                              *
+    *********************************************************************************/
+
+    using asp_H<Psi>::n_blk; using asp_H<Psi>::dim_blk; using asp_H<Psi>::m_int; using asp_H<Psi>::m_error;
+    using asp_H<Psi>::m_walker; using asp_H<Psi>::m_derivate;
+
+    public:
+    //Costruttore (parametri numero blocchi, dimensione blocco, soglia ESS/N e passi di termalizzazione)
+    reweight_H(int num, int dim, double soglia, int term) : asp_H<Psi>(num, dim, term) {
+        m_soglia = soglia; n_rif = 0; m_ess = 0;
+    }
+    //Distruttore
+    ~reweight_H() {;}
+
+    //Metodi Get
+    double Get_soglia() { return m_soglia; }
+    double Get_ess() { return m_ess; }  //ESS dell'ultimo integrale
+    int Get_nrif() { return n_rif; }    //Campioni di riferimento generati finora
+
+    //Metodi Set
+    void Set_soglia(double soglia) { m_soglia = soglia; }
+
+    //Metodo per calcolo dell'integrale
+    void Integrale(var_Mod2<Psi>& val, int stampa) {
+
+        if(stampa == 1 || m_soglia <= 0 || m_derivate) {    //Le derivate vengono da una catena nuova
+            asp_H<Psi>::Integrale(val, stampa);
+            return;
+        }
+
+        if(m_x.size() != (size_t)n_blk * dim_blk) { Riferimento(val); }
+        Stima(val.Get_psi());
+
+        if(m_ess < m_soglia * m_x.size()) {     //Pesi troppo sbilanciati: nuovo riferimento
+            Riferimento(val);
+            Stima(val.Get_psi());
+        }
+    }
+
+
+
+    protected:
+    double m_soglia, m_ess;
+    int n_rif;
+    vector<double> m_x, m_logp;     //Punti di riferimento e loro log del modulo quadro
+    vector<double> m_d, m_e;    //Appoggio: log dei pesi ed energie locali ai nuovi parametri
+
+    //Genera i punti di riferimento con i parametri di val
+    void Riferimento(var_Mod2<Psi>& val) {
+        m_x.resize((size_t)n_blk * dim_blk); m_logp.resize(m_x.size());
+        m_d.resize(m_x.size()); m_e.resize(m_x.size());
+        this->Termalizza(val, m_walker);
+        for(size_t i=0; i<m_x.size(); i++) {
+            val.Move(m_walker);
+            m_x[i] = m_walker;
+            m_logp[i] = val.LogMod2(m_walker);
+        }
+        n_rif++;
+    }
+
+    //Stima pesata di integrale, errore ed ESS con la funzione d'onda psi
+    void Stima(const Psi& psi);
 
 };
 
@@ -170,15 +475,15 @@ class SimAnnealing{
 
     public:
     //Costruttore di default
-    SimAnnealing() { 
-        T_in = 10; T_fin = 0.000001; m_beta = 0; 
-        m_new = 0; m_old = 0; 
+    SimAnnealing() {
+        T_in = 10; T_fin = 0.000001; m_beta = 0;
+        m_new = 0; m_old = 0;
         init(rand); m_delta = 0.1;
     }
     //Costruttore (parametri dimensione blocco e numero blocchi)
-    SimAnnealing(double tin, double tfin, double delta) { 
-        T_in = tin; T_fin = tfin; m_beta = 0; 
-        m_new = 0; m_old = 0; 
+    SimAnnealing(double tin, double tfin, double delta) {
+        T_in = tin; T_fin = tfin; m_beta = 0;
+        m_new = 0; m_old = 0;
         init(rand); m_delta = delta;
     }
     //Distruttore
@@ -192,40 +497,39 @@ class SimAnnealing{
     void SetTin(double tin) { T_in = tin; }
     void SetTfin(double tfin) { T_in = tfin; }
 
-    void SA(asp_H& calcola, var_Mod2& campiona) {
+    template<class Psi>
+    void SA(asp_H<Psi>& calcola, var_Mod2<Psi>& campiona) {
 
         double p = 0;   //Probabilità di accettare la mossa
         int acce = 0;   //Numero di mosse accettato
         double T = T_in;    //Temperatura di partenza SA
-        double appo, pippo; //Variabili di appoggio per le mosse
+        double appo[Psi::n_par]; //Variabili di appoggio per le mosse
 
         ofstream fileout;   //Canale di output
         ofstream file_out;   //Canale di output
         fileout.open("SimAnnealing.dat");
         file_out.open("Parametri.dat");
 
-        //Calcolo l'integrale nelle condizioni iniziali (mu = 1, sigma = 1)
+        //Calcolo l'integrale nelle condizioni iniziali
         calcola.Integrale(campiona, 0);
         m_old = calcola.Get_integrale();
-        fileout << m_old << "   " << calcola.Get_errore() << endl;
-        file_out << campiona.Get_mu() << "   " << campiona.Get_sigma() << endl;
+        fileout << m_old << "   " << calcola.Get_errore() << "\n";
+        Parametri(file_out, campiona);
 
         while(T >= T_fin){
 
             acce = 0;   //Re-setto acce a zero
             m_beta = 1/T;   //Calcolo parametro beta
-            
+
             //Voglio accettare almeno 5 mosse
             while(acce <= 5){
 
-                //Salvo momentaneamente i valori di mu/sigma 
+                //Salvo momentaneamente i valori dei parametri
                 //(vanno cambiati solo se ho accettazione mossa)
-                appo = campiona.Get_mu();
-                pippo = campiona.Get_sigma();
+                for(int k=0; k<Psi::n_par; k++) { appo[k] = campiona.Get_par(k); }
 
                 //Propongo una nuova mossa
-                campiona.Set_mu(appo + m_delta * (rand.Rannyu() - 0.5));
-                campiona.Set_sigma(pippo + m_delta * (rand.Rannyu() - 0.5));
+                for(int k=0; k<Psi::n_par; k++) { campiona.Set_par(k, appo[k] + m_delta * (rand.Rannyu() - 0.5)); }
 
                 //Calcolo l'integrale nella configurazione in cui mi trovo
                 calcola.Integrale(campiona, 0);
@@ -234,15 +538,14 @@ class SimAnnealing{
                 p = exp(-m_beta * (m_new - m_old)); //Probabilità accettazione mossa
                 if(rand.Rannyu() < p) { //Cambio effettivamente oppure no?
                     m_old = m_new;
-                    fileout << m_old << "   " << calcola.Get_errore() << endl;
-                    file_out << campiona.Get_mu() << "   " << campiona.Get_sigma() << endl;
+                    fileout << m_old << "   " << calcola.Get_errore() << "\n";
+                    Parametri(file_out, campiona);
                     acce++;
                 }
 
                 else{
                     //Riporto i parametri a quelli precedenti, se mossa non accetatta devo dimenticarmela
-                    campiona.Set_mu(appo);
-                    campiona.Set_sigma(pippo);
+                    for(int k=0; k<Psi::n_par; k++) { campiona.Set_par(k, appo[k]); }
                 }
 
 
@@ -259,6 +562,14 @@ class SimAnnealing{
     }
 
 
+    //Una riga di Parametri.dat: i parametri di Psi e delta
+    template<class Psi>
+    static void Parametri(ofstream& file_out, var_Mod2<Psi>& campiona) {
+        for(int k=0; k<Psi::n_par; k++) { file_out << campiona.Get_par(k) << "   "; }
+        file_out << campiona.Get_delta() << "\n";
+    }
+
+
     private:
     double T_in, T_fin, m_beta; //Data membri per temperatura
     double m_old, m_new;    //Data membri per valori integrali
@@ -270,4 +581,768 @@ class SimAnnealing{
 
 
 
-#endif //__classi_h__
\ No newline at end of file
+class StocRec{
+
+    /*********************************************************************************
+    *    Stochastic reconfiguration: a ogni iterazione un integrale con le derivate  *
+    *    logaritmiche O_k = d log(psi)/d p_k accese fornisce il gradiente            *
+    *    dell'energia g_k = 2(<E_L O_k> - <E_L><O_k>) e la matrice di covarianza     *
+    *    S_kl = <O_k O_l> - <O_k><O_l>. I parametri p si spostano di                  *
+    *    -tau (S + eps diag(S))^-1 g: eps stabilizza S quando è quasi singolare       *
+    *    (per DueGauss a mu piccolo O_mu e O_sigma sono quasi proporzionali) e il    *
+    *    passo non può superare la lunghezza dmax.                                   *
+    *********************************************************************************/
+
+    public:
+    //Costruttore di default
+    StocRec() { m_tau = 0.1; m_eps = 0.01; m_dmax = 0.1; n_iter = 30; }
+    //Costruttore (parametri passo, regolarizzazione, passo massimo e numero di iterazioni)
+    StocRec(double tau, double eps, double dmax, int iter) { m_tau = tau; m_eps = eps; m_dmax = dmax; n_iter = iter; }
+    //Distruttore
+    ~StocRec() {;}
+
+    //Metodi Get
+    double Get_tau() { return m_tau; }
+    double Get_eps() { return m_eps; }
+    double Get_dmax() { return m_dmax; }
+    int Get_niter() { return n_iter; }
+
+    //Metodi Set
+    void Set_tau(double tau) { m_tau = tau; }
+    void Set_eps(double eps) { m_eps = eps; }
+    void Set_dmax(double dmax) { m_dmax = dmax; }
+    void Set_niter(int iter) { n_iter = iter; }
+
+    template<class Psi>
+    void SR(asp_H<Psi>& calcola, var_Mod2<Psi>& campiona) {
+
+        const int n = Psi::n_par;
+        double g[n], S[n][n], dp[n];   //Gradiente, matrice di covarianza e passo
+        double E, lung;
+
+        ofstream fileout;   //Canale di output
+        ofstream file_out;   //Canale di output
+        fileout.open("StocRec.dat");
+        file_out.open("ParametriSR.dat");
+
+        calcola.Set_derivate(1);
+
+        for(int it=0; it<n_iter; it++){
+
+            calcola.Integrale(campiona, 0);
+            E = calcola.Get_integrale();
+            fileout << E << "   " << calcola.Get_errore() << "\n";
+            SimAnnealing::Parametri(file_out, campiona);
+
+            for(int k=0; k<n; k++) {
+                g[k] = -m_tau * 2 * (calcola.Get_EO(k) - E * calcola.Get_O(k));
+                for(int l=0; l<n; l++) { S[k][l] = calcola.Get_OO(k, l) - calcola.Get_O(k) * calcola.Get_O(l); }
+                S[k][k] *= 1 + m_eps;
+            }
+
+            //Risolvo S dp = -tau g (eliminazione di Gauss con pivot parziale)
+            for(int c=0; c<n; c++) {
+                int piv = c;
+                for(int r=c+1; r<n; r++) { if(fabs(S[r][c]) > fabs(S[piv][c])) { piv = r; } }
+                for(int l=0; l<n; l++) { swap(S[c][l], S[piv][l]); }
+                swap(g[c], g[piv]);
+                for(int r=c+1; r<n; r++) {
+                    double f = S[r][c]/S[c][c];
+                    for(int l=c; l<n; l++) { S[r][l] -= f * S[c][l]; }
+                    g[r] -= f * g[c];
+                }
+            }
+            lung = 0;
+            for(int k=n-1; k>=0; k--) {
+                dp[k] = g[k];
+                for(int l=k+1; l<n; l++) { dp[k] -= S[k][l] * dp[l]; }
+                dp[k] /= S[k][k];
+                lung += dp[k] * dp[k];
+            }
+            lung = sqrt(lung);
+
+            for(int k=0; k<n; k++) {
+                if(lung > m_dmax) { dp[k] *= m_dmax/lung; }
+                campiona.Set_par(k, campiona.Get_par(k) + dp[k]);
+            }
+
+            cout << "Iterazione " << it+1 << ": E = " << E << " +- " << calcola.Get_errore();
+            for(int k=0; k<n; k++) { cout << "   " << Psi::Nome(k) << " = " << campiona.Get_par(k); }
+            cout << endl;
+        }
+
+        calcola.Set_derivate(0);
+        fileout.close();
+        file_out.close();
+
+    }
+
+
+    private:
+    double m_tau, m_eps, m_dmax;    //Passo, regolarizzazione della matrice S e passo massimo
+    int n_iter;     //Numero di iterazioni
+
+};
+
+
+
+
+
+
+template<class Psi>
+class Griglia{
+
+    /*********************************************************************************
+    *    Scansione dell'energia su una griglia n_a x n_b dei parametri 0 e 1 di Psi  *
+    *    (mu e sigma per DueGauss), con gli altri parametri fissi a quelli di psi.   *
+    *    La griglia è divisa in quadrati di vicini x vicini punti, distribuiti fra   *
+    *    n_thread thread a turno (il quadrato q va al thread q % n_thread): ogni     *
+    *    thread ha il suo var_Mod2 con la riga t+1 di Primes, quindi il risultato    *
+    *    non dipende dall'ordine di esecuzione. Con vicini > 1 ogni quadrato parte   *
+    *    da un campione di riferimento al suo centro e i suoi punti sono stimati     *
+    *    ripesandolo (reweight_H), che lo rifà solo se l'ESS scende sotto soglia.    *
+    *    Con vicini = 1 ogni punto è un integrale di asp_H come prima.               *
+    *********************************************************************************/
+
+    public:
+    //Costruttore (funzione d'onda, estremi e numero di punti nei parametri 0 e 1, lato dei quadrati e thread)
+    Griglia(const Psi& psi, double a_min, double a_max, int na, double b_min, double b_max, int nb, int vicini, int thread) {
+        m_psi = psi;
+        m_a_min = a_min; m_a_max = a_max; n_a = na;
+        m_b_min = b_min; m_b_max = b_max; n_b = nb;
+        n_vicini = max(vicini, 1); n_thread = max(thread, 1);
+        m_E.assign((size_t)n_a * n_b, 0); m_err.assign(m_E.size(), 0);
+    }
+    //Distruttore
+    ~Griglia() {;}
+
+    //Metodi Get
+    int Get_na() { return n_a; }
+    int Get_nb() { return n_b; }
+    double Get_a(int i) { return (n_a > 1) ? m_a_min + (m_a_max - m_a_min) * i/(n_a - 1) : m_a_min; }
+    double Get_b(int j) { return (n_b > 1) ? m_b_min + (m_b_max - m_b_min) * j/(n_b - 1) : m_b_min; }
+    double Get_energia(int i, int j) { return m_E[(size_t)i * n_b + j]; }
+    double Get_errore(int i, int j) { return m_err[(size_t)i * n_b + j]; }
+
+    //Scansione con n_blk blocchi da dim_blk punti, passo delta del Metropolis (adattato verso l'accettazione acc se acc > 0),
+    //soglia ESS/N di reweight_H e term passi di termalizzazione
+    void Scansione(int nblk, int dimblk, double delta, double acc, double soglia, int term) {
+        vector<thread> lavoratori;
+        for(int t=0; t<n_thread; t++) {
+            lavoratori.push_back(thread(&Griglia::Lavoratore, this, t, nblk, dimblk, delta, acc, soglia, term));
+        }
+        for(auto& l : lavoratori) { l.join(); }
+    }
+
+    //Scrive le energie su file: una riga per ogni valore del parametro 0, una colonna per ogni valore del parametro 1
+    void Stampa(const char* nome) {
+        ofstream fileout(nome);
+        for(int i=0; i<n_a; i++) {
+            for(int j=0; j<n_b; j++) { fileout << Get_energia(i, j) << " "; }
+            fileout << "\n";
+        }
+        fileout.close();
+    }
+
+
+    private:
+    Psi m_psi;
+    double m_a_min, m_a_max, m_b_min, m_b_max;
+    int n_a, n_b, n_vicini, n_thread;
+    vector<double> m_E, m_err;  //Energia ed errore nei punti (a_i, b_j), indice i * n_b + j
+
+    //Lavoro del thread t: i quadrati t, t + n_thread, ...
+    void Lavoratore(int t, int nblk, int dimblk, double delta, double acc, double soglia, int term) {
+
+        var_Mod2<Psi> campiona(m_psi, delta, t + 1);
+        campiona.Set_accettazione(acc);
+        asp_H<Psi> singolo(nblk, dimblk, term);
+        int q_a = (n_a + n_vicini - 1)/n_vicini, q_b = (n_b + n_vicini - 1)/n_vicini;
+
+        for(int q=t; q<q_a * q_b; q+=n_thread) {
+
+            int i0 = (q/q_b) * n_vicini, i1 = min(i0 + n_vicini, n_a);
+            int j0 = (q % q_b) * n_vicini, j1 = min(j0 + n_vicini, n_b);
+            reweight_H<Psi> ripesato(nblk, dimblk, soglia, term);    //Nuovo riferimento per ogni quadrato
+            asp_H<Psi>& calcola = (n_vicini > 1) ? (asp_H<Psi>&)ripesato : singolo;
+
+            if(n_vicini > 1) {      //Il primo integrale genera il riferimento al centro del quadrato
+                campiona.Set_par(0, 0.5 * (Get_a(i0) + Get_a(i1 - 1)));
+                campiona.Set_par(1, 0.5 * (Get_b(j0) + Get_b(j1 - 1)));
+                calcola.Integrale(campiona, 0);
+            }
+
+            for(int i=i0; i<i1; i++) {
+                for(int j=j0; j<j1; j++) {
+                    campiona.Set_par(0, Get_a(i));
+                    campiona.Set_par(1, Get_b(j));
+                    calcola.Integrale(campiona, 0);
+                    m_E[(size_t)i * n_b + j] = calcola.Get_integrale();
+                    m_err[(size_t)i * n_b + j] = calcola.Get_errore();
+                }
+            }
+        }
+    }
+
+};
+
+
+
+
+
+//Barriera per n thread: Attendi() ritorna quando tutti gli n thread l'hanno chiamata
+class Barriera{
+
+    public:
+    //Costruttore (numero di thread)
+    Barriera(int n) { n_thread = n; n_arrivati = 0; m_giro = 0; }
+    //Distruttore
+    ~Barriera() {;}
+
+    void Attendi() {
+        unique_lock<mutex> lock(m_mutex);
+        long giro = m_giro;
+        if(++n_arrivati == n_thread) { n_arrivati = 0; m_giro++; m_cv.notify_all(); }
+        else { m_cv.wait(lock, [&] { return giro != m_giro; }); }
+    }
+
+    private:
+    int n_thread, n_arrivati;
+    long m_giro;    //Conta le volte che la barriera si è aperta
+    mutex m_mutex;
+    condition_variable m_cv;
+
+};
+
+
+
+
+
+template<class Psi>
+class DMC{
+
+    /*********************************************************************************
+    *    Diffusion Monte Carlo con importance sampling sulla psi di prova di         *
+    *    var_Mod2. Ogni walker diffonde con la deriva v = d log(psi)/dx:             *
+    *    x' = x + tau v(x) + sqrt(tau) eta, e la mossa è accettata col Metropolis    *
+    *    (psi(x')^2 G(x'->x))/(psi(x)^2 G(x->x')), che riduce l'errore di tau.       *
+    *    Poi il walker ha peso w = exp(-tau ((E_L(x) + E_L(x'))/2 - E_T)) e          *
+    *    int(w + u) figli (al massimo 3). La stima dell'energia è la media delle     *
+    *    energie locali pesata con w; E_T = E_passo - 0.1/tau log(N/N_0) riporta      *
+    *    la popolazione verso N_0 in circa 10 passi.                                 *
+    *                                                                                *
+    *    I walker stanno in due copie di array contigui (posizione, log|psi|^2, E_L, *
+    *    deriva) lunghe n_max = 4 N_0, allocate nel costruttore: a ogni passo i figli *
+    *    vengono copiati dalla copia attuale all'altra e le copie si scambiano, senza *
+    *    allocazioni. I walker sono divisi in n_thread parti contigue; con gli        *
+    *    offset dati dalle somme dei figli dei thread precedenti ogni thread scrive   *
+    *    i suoi figli senza sovrapporsi agli altri. Ogni walker a ogni passo usa un   *
+    *    blocco di Philox (gaussiana, Metropolis e figli) con contatore (passo,      *
+    *    walker), quindi il risultato non dipende dal numero di thread.              *
+    *********************************************************************************/
+
+    public:
+    //Costruttore (parametri passo tau, walker N_0, numero blocchi, passi per blocco, passi di termalizzazione e thread)
+    DMC(double tau, int walk, int num, int passi, int term, int thread) {
+        m_tau = tau; n_0 = walk; n_max = 4 * walk; n_blk = num; n_passi = passi; n_term = term; n_thread = max(thread, 1);
+        for(int b=0; b<2; b++) { m_x[b].assign(n_max, 0); m_logp[b].assign(n_max, 0); m_eloc[b].assign(n_max, 0); m_v[b].assign(n_max, 0); }
+        m_figli.assign(n_max, 0); m_parz.assign(4 * n_thread, 0);
+        init(rnd); m_philox = Philox((uint32_t)(rnd.Rannyu() * 4294967296.), 1); m_passo = 0;
+        m_int = 0; m_error = 0; m_acc = 0; m_pop = 0; n_persi = 0;
+    }
+    //Distruttore
+    ~DMC() {;}
+
+    //Metodi Get
+    double Get_tau() { return m_tau; }
+    double Get_energia() { return m_int; }
+    double Get_errore() { return m_error; }
+    double Get_accettazione() { return m_acc; }     //Frazione di mosse accettate
+    double Get_popolazione() { return m_pop; }      //Popolazione media
+    long Get_persi() { return n_persi; }    //Figli scartati perché la popolazione superava n_max
+
+    //Metodi Set
+    void Set_tau(double tau) { m_tau = tau; }
+
+    //Metodo per il calcolo: i walker partono da campioni di |psi|^2 generati con val
+    void Esegui(var_Mod2<Psi>& val, int stampa) {
+
+        Inizializza(val);
+
+        ofstream fileout;
+        if(stampa == 1){
+            fileout.open("DMC.dat");
+        }
+
+        Barriera barriera(n_thread);
+        vector<thread> lavoratori;
+        for(int t=0; t<n_thread; t++) {
+            lavoratori.push_back(thread(&DMC::Lavoro, this, t, val.Get_psi(), &barriera, stampa, &fileout));
+        }
+        for(auto& l : lavoratori) { l.join(); }
+        m_passo += n_term + (uint64_t)n_blk * n_passi;
+
+        if(stampa == 1) {
+            cout << endl << "--------------------------------------------------------" << endl;
+            cout << endl << endl << "Effettuato DMC con tau = " << m_tau << " e popolazione media " << m_pop << endl;
+            cout << "Accettazione: " << m_acc * 100 << " %" << endl;
+            cout << "Energia DMC: " << m_int << endl;
+            cout << "Errore energia DMC: " << m_error << endl << endl << endl;
+            fileout.close();
+        }
+    }
+
+
+
+    private:
+    double m_tau;
+    int n_0, n_max, n_blk, n_passi, n_term, n_thread;
+    int n_iniz;     //Popolazione di partenza
+    double m_int, m_error, m_acc, m_pop;
+    long n_persi;
+    vector<double> m_x[2], m_logp[2], m_eloc[2], m_v[2];    //Le due copie dei walker
+    vector<int> m_figli;    //Figli di ogni walker nel passo corrente
+    vector<double> m_parz;  //Somme di ogni thread nel passo: w, w E_L, accettate, figli
+    Random rnd; Philox m_philox; uint64_t m_passo;
+
+    //N_0 walker presi ogni 10 move da una catena di Metropolis su |psi|^2
+    void Inizializza(var_Mod2<Psi>& val) {
+        double x = 0;
+        for(int i=0; i<1000; i++) { val.Move(x); }
+        for(int w=0; w<n_0; w++) {
+            for(int i=0; i<10; i++) { val.Move(x); }
+            m_x[0][w] = x;
+            val.Get_psi().Completo(x, m_logp[0][w], m_eloc[0][w], m_v[0][w]);
+        }
+        n_iniz = n_0;
+    }
+
+    //Lavoro del thread t per tutti i passi (solo il thread 0 accumula i blocchi e scrive)
+    void Lavoro(int t, const Psi psi, Barriera* barriera, int stampa, ofstream* fileout);
+
+    //Diffusione, Metropolis e numero di figli dei walker da w0 a w1 della copia b (somme in parz)
+    void Spinta(int w0, int w1, int b, const Psi& psi, uint64_t passo, double e_t, double* parz);
+
+};
+
+
+
+
+
+class Scrittore{
+
+    /*********************************************************************************
+    *    Destinazione dei campioni del modulo quadro (Campionamento). Il main non    *
+    *    sa se i punti finiscono in un file di testo, in un file binario o in un     *
+    *    istogramma: chiama Scrivi(x) per ogni punto e Chiudi() alla fine. Nessuna   *
+    *    delle implementazioni svuota il buffer a ogni punto.                        *
+    *********************************************************************************/
+
+    public:
+    //Distruttore
+    virtual ~Scrittore() {;}
+
+    //Aggiunge un campione
+    virtual void Scrivi(double x) = 0;
+    //Scrive quello che resta in memoria e chiude il file
+    virtual void Chiudi() = 0;
+    //Vero se il file di uscita non si è aperto
+    virtual bool Errore() { return false; }
+
+};
+
+
+
+
+
+class Scrittore_testo : public Scrittore{
+
+    //Un numero per riga, come il vecchio Campionamento.dat (ma senza endl a ogni riga)
+
+    public:
+    //Costruttore (nome del file)
+    Scrittore_testo(const char* nome) { m_buffer.resize(1 << 20); m_file.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size()); m_file.open(nome); }
+    //Distruttore
+    ~Scrittore_testo() { Chiudi(); }
+
+    void Scrivi(double x) { m_file << x << '\n'; }
+    void Chiudi() { if(m_file.is_open()) { m_file.close(); } }
+    bool Errore() { return !m_file; }
+
+    private:
+    vector<char> m_buffer;  //Buffer di 1 MB dello stream
+    ofstream m_file;
+
+};
+
+
+
+
+
+class Scrittore_binario : public Scrittore{
+
+    //double a 64 bit nell'ordine dei byte della macchina, senza intestazione:
+    //in python np.fromfile("Campionamento.bin") restituisce i campioni
+
+    public:
+    //Costruttore (nome del file e numero di campioni tenuti in memoria prima di scrivere)
+    Scrittore_binario(const char* nome, int dim = 1 << 17) { m_file.open(nome, ios::binary); m_buffer.reserve(dim); m_dim = dim; }
+    //Distruttore
+    ~Scrittore_binario() { Chiudi(); }
+
+    void Scrivi(double x) {
+        m_buffer.push_back(x);
+        if((int)m_buffer.size() == m_dim) { Svuota(); }
+    }
+    void Chiudi() { if(m_file.is_open()) { Svuota(); m_file.close(); } }
+    bool Errore() { return !m_file; }
+
+    private:
+    ofstream m_file;
+    vector<double> m_buffer;    //Campioni non ancora scritti
+    int m_dim;
+
+    void Svuota() {
+        m_file.write((const char*)m_buffer.data(), m_buffer.size() * sizeof(double));
+        m_buffer.clear();
+    }
+
+};
+
+
+
+
+
+class Istogramma : public Scrittore{
+
+    //I campioni non vengono salvati: Chiudi() scrive centro del bin, densità di probabilità
+    //ed errore di ogni bin. I campioni di Metropolis sono correlati, quindi l'errore non è
+    //quello poissoniano ma viene dalle medie a blocchi di dim_blk campioni consecutivi (come
+    //per gli integrali); l'ultimo blocco, se incompleto, conta solo nella densità.
+    //I punti fuori da [x_min, x_max) sono solo contati
+
+    public:
+    //Costruttore (nome del file, numero di bin, estremi e campioni per blocco)
+    Istogramma(const char* nome, int bin, double x_min, double x_max, long dim_blk) {
+        m_file.open(nome);
+        n_bin = bin; m_min = x_min; m_max = x_max; m_largo = (m_max - m_min)/n_bin; m_dim = dim_blk;
+        m_conta.assign(n_bin, 0); m_blocco.assign(n_bin, 0); m_somma.assign(n_bin, 0); m_somma2.assign(n_bin, 0);
+        n_tot = 0; n_fuori = 0; n_blocco = 0; n_blk = 0;
+    }
+    //Distruttore
+    ~Istogramma() { Chiudi(); }
+
+    //Metodi Get
+    long Get_conteggio(int i) { return m_conta[i]; }
+    long Get_fuori() { return n_fuori; }
+
+    void Scrivi(double x) {
+        double k = (x - m_min)/(m_max - m_min) * n_bin;
+        if(k >= 0 && k < n_bin) { m_conta[(int)k]++; m_blocco[(int)k]++; }
+        else { n_fuori++; }
+        n_tot++;
+        if(++n_blocco == m_dim) { FineBlocco(); }
+    }
+
+    void Chiudi() {
+        if(!m_file.is_open()) { return; }
+        double norma = (n_tot > 0) ? 1/(n_tot * m_largo) : 0;
+        for(int i=0; i<n_bin; i++) {
+            double errore = 0;
+            if(n_blk > 1) {
+                double media = m_somma[i]/n_blk, media2 = m_somma2[i]/n_blk;
+                errore = sqrt(fabs(media2 - media * media)/(n_blk - 1));
+            }
+            m_file << m_min + (i + 0.5) * m_largo << "   " << m_conta[i] * norma << "   " << errore << "\n";
+        }
+        m_file.close();
+    }
+    bool Errore() { return !m_file; }
+
+    private:
+    ofstream m_file;
+    int n_bin;
+    double m_min, m_max, m_largo;
+    long m_dim;     //Campioni per blocco
+    vector<long> m_conta, m_blocco;     //Conteggi totali e del blocco corrente
+    vector<double> m_somma, m_somma2;   //Somme delle densità dei blocchi e dei loro quadrati
+    long n_tot, n_fuori, n_blocco, n_blk;
+
+    //Aggiunge la densità del blocco appena finito alle somme
+    void FineBlocco() {
+        for(int i=0; i<n_bin; i++) {
+            double h = m_blocco[i]/(m_dim * m_largo);
+            m_somma[i] += h; m_somma2[i] += h * h;
+            m_blocco[i] = 0;
+        }
+        n_blocco = 0; n_blk++;
+    }
+
+};
+
+
+
+
+
+//Termalizzazione e blocchi di ensemble_H per i walker da w0 a w1
+template<class Psi>
+void ensemble_H<Psi>::Gruppo(int w0, int w1, int passi, const Psi psi, double delta, double* somme, long* acce, double* der) {
+
+    const int n_par = Psi::n_par;
+    double* x = m_x.data();
+    double* logp = m_logp.data();
+    double* eloc = m_eloc.data();
+    double* ow = m_o.data();
+    double* on = m_on.data();
+    double* dw = m_dw.data();
+    const int nw = n_walk;
+    const double scala = 2.3283064365386963e-10;    //2^-32: da parola di Philox a numero in [0,1)
+    const Philox philox = m_philox;     //Copia locale: la chiave resta nei registri
+
+    //I parametri sono cambiati: ricalcolo lo stato dei walker
+    if(der) {
+        #pragma omp simd
+        for(int w=w0; w<w1; w++) { double d1; psi.Completo(x[w], logp[w], eloc[w], d1, ow + w, nw); }
+    }
+    else {
+        #pragma omp simd
+        for(int w=w0; w<w1; w++) { psi.Punto(x[w], logp[w], eloc[w]); }
+    }
+
+    //Blocco -1: termalizzazione (n_term passi), poi n_blk blocchi di "passi" passi
+    uint64_t passo = m_passo;
+    for(int i=-1; i<n_blk; i++) {
+
+        int n_passi = (i < 0) ? n_term : passi;
+        double somma = 0;
+        long acc = 0;
+        if(der && i == 0) { for(int m=0; m<n_der; m++) { for(int w=w0; w<w1; w++) { dw[m * nw + w] = 0; } } }
+
+        for(int j=0; j<n_passi; j++, passo++) {
+
+            if(der) {   //Stesso passo, con le derivate logaritmiche O_k, E_L O_k, O_k O_l dalla stessa exp
+                #pragma omp simd reduction(+:somma,acc)
+                for(int w=w0; w<w1; w++) {
+                    uint32_t r0, r1, r2, r3;
+                    philox.Block((uint32_t)passo, (uint32_t)(passo >> 32), (uint32_t)w, 0, r0, r1, r2, r3);
+
+                    double x_new = x[w] + ((r0 + 0.5) * scala - 0.5) * delta;
+                    double lp_new, el_new, d1;
+                    psi.Completo(x_new, lp_new, el_new, d1, on + w, nw);
+
+                    bool ok = (r1 + 0.5) * scala < exp(lp_new - logp[w]);
+                    x[w] = ok ? x_new : x[w];
+                    logp[w] = ok ? lp_new : logp[w];
+                    eloc[w] = ok ? el_new : eloc[w];
+                    somma += eloc[w];
+                    acc += ok;
+                    for(int k=0; k<n_par; k++) { ow[k * nw + w] = ok ? on[k * nw + w] : ow[k * nw + w]; }
+                    for(int k=0; k<n_par; k++) {
+                        dw[k * nw + w] += ow[k * nw + w]; dw[(n_par + k) * nw + w] += eloc[w] * ow[k * nw + w];
+                        for(int l=0; l<n_par; l++) { dw[(2 * n_par + k * n_par + l) * nw + w] += ow[k * nw + w] * ow[l * nw + w]; }
+                    }
+                }
+            }
+            else {
+                #pragma omp simd reduction(+:somma,acc)
+                for(int w=w0; w<w1; w++) {
+                    uint32_t r0, r1, r2, r3;    //Numeri casuali del walker w al passo "passo"
+                    philox.Block((uint32_t)passo, (uint32_t)(passo >> 32), (uint32_t)w, 0, r0, r1, r2, r3);
+
+                    double x_new = x[w] + ((r0 + 0.5) * scala - 0.5) * delta;   //Nuova posizione
+                    double lp_new, el_new;
+                    psi.Punto(x_new, lp_new, el_new);
+
+                    bool ok = (r1 + 0.5) * scala < exp(lp_new - logp[w]);    //Metropolis
+                    x[w] = ok ? x_new : x[w];
+                    logp[w] = ok ? lp_new : logp[w];
+                    eloc[w] = ok ? el_new : eloc[w];
+                    somma += eloc[w];
+                    acc += ok;
+                }
+            }
+        }
+
+        if(i >= 0) {
+            somme[i] = somma;
+            acce[i] = acc;
+        }
+    }
+
+    if(der) { for(int m=0; m<n_der; m++) { for(int w=w0; w<w1; w++) { der[m] += dw[m * nw + w]; } } }
+}
+
+
+
+
+//Stima pesata di reweight_H: i pesi sono exp(d - d_max), con d = log|psi_new|^2 - log|psi_rif|^2
+template<class Psi>
+void reweight_H<Psi>::Stima(const Psi& psi_rif) {
+
+    const Psi psi = psi_rif;    //Copia locale per il ciclo vettorizzato
+    const int n = m_x.size();
+    const double* x = m_x.data();
+    const double* logp = m_logp.data();
+    double* d = m_d.data();
+    double* e = m_e.data();
+
+    double d_max = -1e300;
+    #pragma omp simd reduction(max:d_max)
+    for(int i=0; i<n; i++) {
+        double lp;
+        psi.Punto(x[i], lp, e[i]);
+        d[i] = lp - logp[i];
+        d_max = fmax(d_max, d[i]);
+    }
+
+    double appo = 0, appo2 = 0, sw = 0, sw2 = 0;
+    m_int = 0; m_error = 0;
+
+    for(int i=0; i<n_blk; i++) {
+        double swb = 0, sweb = 0;
+        #pragma omp simd reduction(+:swb,sweb,sw2)
+        for(int j=i*dim_blk; j<(i+1)*dim_blk; j++) {
+            double w = exp(d[j] - d_max);
+            swb += w; sweb += w * e[j]; sw2 += w * w;
+        }
+        sw += swb;
+        appo = sweb/swb;    //Stima pesata del blocco
+
+        m_int = m_int * i/(i+1) + appo/(i+1);   //Stima integrale post i-esimo blocco
+        appo2 = appo2 * i/(i+1) + appo * appo/(i+1);    //Valore per errore
+    }
+
+    if(n_blk != 1) { m_error = sqrt((appo2 - pow(m_int, 2))/(n_blk - 1)); } //Associo errore alla stima
+    m_ess = sw * sw/sw2;
+}
+
+
+
+
+
+//Tutti i passi del DMC per il thread t: Spinta sulla sua parte dei walker, barriera, copia dei
+//figli nell'altra copia, barriera. Ogni thread calcola da solo (e uguale agli altri) popolazione ed E_T
+template<class Psi>
+void DMC<Psi>::Lavoro(int t, const Psi psi, Barriera* barriera, int stampa, ofstream* fileout) {
+
+    int b = 0, n = n_iniz;
+    uint64_t passo = m_passo;
+    double e_t = 0, appo = 0, appo2 = 0, pop = 0, acc = 0;
+    for(int w=0; w<n; w++) { e_t += m_eloc[0][w]; }
+    e_t /= n;
+
+    //Blocco -1: termalizzazione (n_term passi), poi n_blk blocchi di n_passi passi
+    for(int i=-1; i<n_blk; i++) {
+
+        int passi = (i < 0) ? n_term : n_passi;
+        double sw = 0, swe = 0, pop_blk = 0, acc_blk = 0;
+
+        for(int j=0; j<passi; j++, passo++) {
+
+            int w0 = (long)n * t/n_thread, w1 = (long)n * (t + 1)/n_thread;
+            Spinta(w0, w1, b, psi, passo, e_t, &m_parz[4 * t]);
+            barriera->Attendi();
+
+            //Somme dei thread, sempre nello stesso ordine
+            double sw_p = 0, swe_p = 0, acc_p = 0;
+            long figli = 0, offset = 0;
+            for(int s=0; s<n_thread; s++) {
+                if(s == t) { offset = figli; }
+                sw_p += m_parz[4 * s]; swe_p += m_parz[4 * s + 1]; acc_p += m_parz[4 * s + 2];
+                figli += (long)m_parz[4 * s + 3];
+            }
+
+            if(figli > 0) {     //Copio i figli dei miei walker nell'altra copia
+                double *x = m_x[b].data(), *lp = m_logp[b].data(), *el = m_eloc[b].data(), *v = m_v[b].data();
+                double *xn = m_x[1-b].data(), *lpn = m_logp[1-b].data(), *eln = m_eloc[1-b].data(), *vn = m_v[1-b].data();
+                for(int w=w0; w<w1; w++) {
+                    for(int c=0; c<m_figli[w] && offset<n_max; c++, offset++) {
+                        xn[offset] = x[w]; lpn[offset] = lp[w]; eln[offset] = el[w]; vn[offset] = v[w];
+                    }
+                }
+            }
+
+            if(t == 0) {
+                if(figli > n_max) { n_persi += figli - n_max; }
+                sw += sw_p; swe += swe_p; pop_blk += n; acc_blk += acc_p;
+            }
+            barriera->Attendi();
+
+            if(figli > 0) { b = 1 - b; n = min(figli, (long)n_max); }     //Se sono morti tutti resto dove sono
+            e_t = swe_p/sw_p - 0.1/m_tau * log((double)n/n_0);
+        }
+
+        if(t != 0 || i < 0) { continue; }
+
+        //Stima del blocco: media delle E_L pesata con i pesi di tutti i passi
+        double blk = swe/sw;
+        appo = appo * i/(i+1) + blk/(i+1);
+        appo2 = appo2 * i/(i+1) + blk * blk/(i+1);
+        pop += pop_blk/passi; acc += acc_blk/pop_blk;
+        m_int = appo;
+        m_error = (i == 0) ? 0 : sqrt((appo2 - appo * appo)/i);
+
+        if(stampa == 1) {
+            cout << endl << "--------------------------------------------------------" << endl;
+            cout << endl << endl << "DMC: calcolata stima " << i+1 << "-esimo blocco" << endl;
+            cout << "Popolazione media: " << pop_blk/passi << "   accettazione: " << acc_blk/pop_blk * 100 << " %" << endl;
+            *fileout << m_int << "   " << m_error << "   " << pop_blk/passi << "\n";
+        }
+    }
+
+    if(t == 0) { m_pop = pop/n_blk; m_acc = acc/n_blk; }
+}
+
+
+
+
+//Un passo per i walker da w0 a w1: numeri casuali da Philox (r0, r1 gaussiana di Box-Muller,
+//r2 Metropolis, r3 arrotondamento dei figli), nuovo stato scritto al posto del vecchio
+template<class Psi>
+void DMC<Psi>::Spinta(int w0, int w1, int b, const Psi& psi_rif, uint64_t passo, double e_t, double* parz) {
+
+    const Psi psi = psi_rif;    //Copia locale per il ciclo vettorizzato
+    double* x = m_x[b].data();
+    double* logp = m_logp[b].data();
+    double* eloc = m_eloc[b].data();
+    double* v = m_v[b].data();
+    int* figli = m_figli.data();
+    const double tau = m_tau, st = sqrt(m_tau);
+    const double scala = 2.3283064365386963e-10;    //2^-32: da parola di Philox a numero in (0,1)
+    const Philox philox = m_philox;
+
+    double sw = 0, swe = 0, acc = 0, tot = 0;
+    #pragma omp simd reduction(+:sw,swe,acc,tot)
+    for(int w=w0; w<w1; w++) {
+        uint32_t r0, r1, r2, r3;
+        philox.Block((uint32_t)passo, (uint32_t)(passo >> 32), (uint32_t)w, 0, r0, r1, r2, r3);
+
+        double eta = sqrt(-2 * log((r0 + 0.5) * scala)) * cos(2 * M_PI * (r1 + 0.5) * scala);
+        double x_new = x[w] + tau * v[w] + st * eta;
+        double lp_new, el_new, v_new;
+        psi.Completo(x_new, lp_new, el_new, v_new);
+
+        //Rapporto di Metropolis con le probabilità di transizione G(x->x') e G(x'->x)
+        double avanti = x_new - x[w] - tau * v[w], indietro = x[w] - x_new - tau * v_new;
+        bool ok = (r2 + 0.5) * scala < exp(lp_new - logp[w] + (avanti * avanti - indietro * indietro)/(2 * tau));
+
+        double el_old = eloc[w];
+        x[w] = ok ? x_new : x[w];
+        logp[w] = ok ? lp_new : logp[w];
+        eloc[w] = ok ? el_new : eloc[w];
+        v[w] = ok ? v_new : v[w];
+
+        double peso = exp(-tau * (0.5 * (el_old + eloc[w]) - e_t));
+        int f = min((int)(peso + (r3 + 0.5) * scala), 3);
+        figli[w] = f;
+        sw += peso; swe += peso * eloc[w]; acc += ok; tot += f;
+    }
+
+    parz[0] = sw; parz[1] = swe; parz[2] = acc; parz[3] = tot;
+}
+
+
+
+
+
+#endif //__classi_h__
@@ -0,0 +1,145 @@
+#ifndef __funzioni_onda_h__
+#define __funzioni_onda_h__
+
+#include <cmath>
+
+using namespace std;
+
+
+/*************************************************************************************
+*                                                                                    *
+*                           FUNZIONI D'ONDA DI PROVA                                 *
+*                                                                                    *
+**************************************************************************************
+*                                                                                    *
+*   Le classi di classi.h sono template sul tipo della funzione d'onda di prova,     *
+*   che contiene anche il potenziale dell'hamiltoniana. Un tipo Psi deve fornire:    *
+*                                                                                    *
+*     static const int n_par;               numero di parametri variazionali         *
+*     double Get_par(int k) const;          parametro k                              *
+*     void Set_par(int k, double p);        cambia il parametro k                    *
+*     static const char* Nome(int k);       nome del parametro k (per le stampe)     *
+*     double LogMod2(double x) const;       log|psi(x)|^2                            *
+*     double D1(double x) const;            d log(psi)/dx                            *
+*     double D2(double x) const;            d^2 log(psi)/dx^2                        *
+*     double V(double x) const;             potenziale                               *
+*     void Derivate(double x, double* o) const;   o[k] = d log(psi)/d p_k            *
+*     void Punto(double x, double& logp, double& eloc) const;                        *
+*     void Completo(double x, double& logp, double& eloc, double& d1,                *
+*                   double* o = nullptr, int passo = 1) const;                       *
+*                                                                                    *
+*   Punto restituisce insieme log|psi|^2 ed energia locale, Completo anche la        *
+*   deriva d1 = D1(x) e, se o non è nullptr, le derivate o[k * passo] rispetto ai    *
+*   parametri (passo > 1 per scriverle in array per walker, che nei cicli simd al    *
+*   contrario di un array locale non richiedono scatter): sono i kernel dei          *
+*   cicli caldi (var_Mod2, ensemble_H, DMC), quindi devono calcolare una volta sola  *
+*   le funzioni trascendenti comuni e non avere salti o chiamate non inline. Le      *
+*   quantità che dipendono solo dai parametri vanno calcolate in Set_par.            *
+*   L'energia locale è E_L = -1/2 (D2 + D1^2) + V (hbar = m = 1), vedi Eloc.         *
+*   Tutto è risolto in compilazione: nel campionamento non ci sono chiamate          *
+*   virtuali.                                                                        *
+*                                                                                    *
+*************************************************************************************/
+
+
+
+//Energia locale a partire da derivate di log(psi) e potenziale
+template<class Psi> inline double Eloc(const Psi& psi, double x) {
+    double d1 = psi.D1(x);
+    return -0.5 * (psi.D2(x) + d1 * d1) + psi.V(x);
+}
+
+
+
+
+//Potenziale a doppia buca V(x) = x^4 - 5/2 x^2
+struct DoppiaBuca{
+    static double V(double x) { return x * x * x * x - 2.5 * x * x; }
+};
+
+
+
+
+template<class Pot = DoppiaBuca>
+class DueGauss{
+
+    /*********************************************************************************
+    *    psi(x) = exp(-(x-mu)^2/(2 sigma^2)) + exp(-(x+mu)^2/(2 sigma^2))            *
+    *           = 2 exp(-(x^2+mu^2)/(2 sigma^2)) cosh(a),   a = x mu/sigma^2         *
+    *    Con 2 cosh(a) = exp(|a|)(1 + exp(-2|a|)) log|psi|^2 non va mai in overflow  *
+    *    e tanh(a) = sign(a)(1 - e)/(1 + e), e = exp(-2|a|): una sola exp per punto. *
+    *    psi dipende solo da sigma^2, quindi sigma viene tenuto positivo.            *
+    *    sigma^2, 1/sigma^2, 1/sigma^3, mu^2, mu/sigma^2 e (sigma^2-mu^2)/(2sigma^4) *
+    *    sono ricalcolati solo quando cambia un parametro.                           *
+    *********************************************************************************/
+
+    public:
+    static const int n_par = 2;     //mu, sigma
+
+    //Costruttore
+    DueGauss(double mu = 1, double sigma = 1) { m_mu = mu; m_sigma = fabs(sigma); Precalcola(); }
+
+    //Metodi Get e Set dei parametri (0 mu, 1 sigma)
+    double Get_par(int k) const { return (k == 0) ? m_mu : m_sigma; }
+    void Set_par(int k, double p) { if(k == 0) { m_mu = p; } else { m_sigma = fabs(p); } Precalcola(); }
+    static const char* Nome(int k) { return (k == 0) ? "mu" : "sigma"; }
+
+    double LogMod2(double x) const {
+        double b = fabs(x * m_mu_s2);
+        return -(x * x + m_mu2) * m_inv_s2 + 2 * (b + log(1 + exp(-2 * b)));
+    }
+
+    double D1(double x) const { return (m_mu * Tanh(x * m_mu_s2) - x) * m_inv_s2; }
+
+    double D2(double x) const {
+        double th = Tanh(x * m_mu_s2);
+        return (m_mu2 * (1 - th * th) * m_inv_s2 - 1) * m_inv_s2;
+    }
+
+    double V(double x) const { return Pot::V(x); }
+
+    //d log(psi)/d mu = (x tanh(a) - mu)/sigma^2,  d log(psi)/d sigma = (x^2 + mu^2 - 2 x mu tanh(a))/sigma^3
+    void Derivate(double x, double* o) const {
+        double xth = x * Tanh(x * m_mu_s2);
+        o[0] = (xth - m_mu) * m_inv_s2;
+        o[1] = (x * x + m_mu2 - 2 * m_mu * xth) * m_inv_s3;
+    }
+
+    //log|psi|^2 ed E_L = (sigma^2 - mu^2 - x^2 + 2 x mu tanh(a))/(2 sigma^4) + V con una exp e un log
+    void Punto(double x, double& logp, double& eloc) const {
+        double a = x * m_mu_s2, b = fabs(a), e = exp(-2 * b);
+        logp = -(x * x + m_mu2) * m_inv_s2 + 2 * (b + log(1 + e));
+        double th = copysign((1 - e)/(1 + e), a);
+        eloc = m_e0 + (2 * m_mu * x * th - x * x) * 0.5 * m_inv_s2 * m_inv_s2 + Pot::V(x);
+    }
+
+    //Punto, deriva e derivate rispetto ai parametri con la stessa exp
+    void Completo(double x, double& logp, double& eloc, double& d1, double* o = nullptr, int passo = 1) const {
+        double a = x * m_mu_s2, b = fabs(a), e = exp(-2 * b);
+        logp = -(x * x + m_mu2) * m_inv_s2 + 2 * (b + log(1 + e));
+        double th = copysign((1 - e)/(1 + e), a), xth = x * th;
+        double r2 = x * x + m_mu2 - 2 * m_mu * xth;     //(x - mu tanh(a))^2 + mu^2 (1 - tanh(a)^2)
+        eloc = m_e0 + (m_mu2 - r2) * 0.5 * m_inv_s2 * m_inv_s2 + Pot::V(x);
+        d1 = (m_mu * th - x) * m_inv_s2;
+        if(o) { o[0] = (xth - m_mu) * m_inv_s2; o[passo] = r2 * m_inv_s3; }
+    }
+
+    private:
+    double m_mu, m_sigma;
+    double m_mu2, m_inv_s2, m_inv_s3, m_mu_s2, m_e0;    //Quantità che dipendono solo dai parametri
+
+    void Precalcola() {
+        double s2 = m_sigma * m_sigma;
+        m_mu2 = m_mu * m_mu; m_inv_s2 = 1/s2; m_inv_s3 = m_inv_s2/m_sigma; m_mu_s2 = m_mu * m_inv_s2;
+        m_e0 = (s2 - m_mu2) * 0.5 * m_inv_s2 * m_inv_s2;
+    }
+
+    //tanh scritta con una exp, vettorizzabile
+    static double Tanh(double a) { double e = exp(-2 * fabs(a)); return copysign((1 - e)/(1 + e), a); }
+
+};
+
+
+
+
+#endif //__funzioni_onda_h__
@@ -14,6 +14,8 @@
 
 using namespace std;
 
+typedef DueGauss<DoppiaBuca> Psi;   //Funzione d'onda di prova e potenziale, vedi funzioni_onda.h
+
 
 /*************************************************************************************
 *                                                                                    *
@@ -47,6 +49,27 @@ using namespace std;
 *   parametro serve per decidere se stampare a file/terminale oppure no              *
 *   i valori dei singoli blocchi e i rispettivi acceptance rate, mentre il           *
 *   primo per campionare la p(x).                                                    *
+*   Il walker non riparte da x = 0 a ogni chiamata: continua dalla posizione in      *
+*   cui l'ha lasciato l'integrale precedente e fa "nterm" passi di termalizzazione   *
+*   prima del primo blocco. Se "accettazione" è > 0, durante questi passi delta      *
+*   viene adattato (var_Mod2::Adatta) verso l'accettazione obiettivo e poi resta     *
+*   fisso per tutti i blocchi; il valore scelto è la terza colonna di Parametri.dat. *
+*                                                                                    *
+*   I campioni del modulo quadro passano da uno "Scrittore": testo in                *
+*   Campionamento.dat (uscita = 0), double binari in Campionamento.bin (1) o         *
+*   solo l'istogramma normalizzato in Istogramma.dat (2), senza scrivere i punti.    *
+*   L'errore dell'istogramma viene dalle medie su nblk blocchi di campioni.          *
+*                                                                                    *
+*   Tutte le classi sono template sulla funzione d'onda di prova (typedef Psi qui    *
+*   sopra): psi, le sue derivate, il potenziale e i parametri variazionali stanno    *
+*   in funzioni_onda.h. DueGauss<DoppiaBuca> è la psi a due gaussiane (mu, sigma)    *
+*   con V = x^4 - 5/2 x^2; un'altra psi o un altro potenziale si usano cambiando     *
+*   il typedef, senza chiamate virtuali nel campionamento.                           *
+*                                                                                    *
+*   Con dmc = 1, dopo l'ottimizzazione "DMC" fa un Diffusion Monte Carlo con         *
+*   importance sampling sulla psi ottimizzata (deriva ed energia locale vengono      *
+*   da Psi): l'energia in DMC.dat non è più un limite superiore ma quella esatta     *
+*   del ground state, a meno dell'errore di tau e di popolazione.                    *
 *                                                                                    *
 *   La terza classe è "SimAnnealing" e consente di effettuare la vera e propria      *
 *   ottimizzazione. Essa ha come data membri protetti la temperatura iniziale,       *
@@ -58,6 +81,23 @@ using namespace std;
 *   di un elemento di tipo asp_H per calcolare i vari integrali e di uno di tipo     *
 *   var_Mod2 per campionare la distribuzione di probabilità.                         *
 *                                                                                    *
+*   "ensemble_H" deriva da asp_H e calcola lo stesso integrale con una popolazione   *
+*   di walker salvati in array contigui: il ciclo sui walker è vettorizzato e i      *
+*   walker sono divisi fra più thread. Si sceglie con il parametro "integratore"     *
+*   di input.in; SimAnnealing lo usa attraverso asp_H& senza accorgersene.           *
+*                                                                                    *
+*   "reweight_H" (integratore = 2) è il correlated sampling: stima l'energia a       *
+*   parametri vicini ripesando un campione di riferimento salvato, e lo rigenera     *
+*   solo quando la dimensione efficace del campione scende sotto soglia.             *
+*                                                                                    *
+*   "StocRec" (ottimizzatore = 1) sostituisce il SA con la stochastic                *
+*   reconfiguration: durante l'integrale si accumulano le derivate analitiche di     *
+*   log(psi) rispetto a mu e sigma, da cui gradiente e matrice S per il passo.       *
+*                                                                                    *
+*   "Griglia" calcola l'energia su una griglia di (mu, sigma) per Grafico.dat:       *
+*   i punti sono divisi fra nthread thread, ognuno con la sua sequenza casuale,      *
+*   e i punti vicini possono condividere un campione ripesato (reweight_H).          *
+*                                                                                    *
 *************************************************************************************/
 
 
@@ -68,8 +108,18 @@ int main (int argc, char *argv[]){
     double mu, sigma;
     double Tin, Tfin, delta1;
     int nblk, dimblk, camp, appo;
+    int integratore, nwalk, nterm, nthread;
+    double soglia;
+    int ottimizzatore, iter_sr;
+    double tau, eps, dmax;
+    double mu_min, mu_max, sigma_min, sigma_max;
+    int nmu, nsigma, vicini;
+    double accettazione;
+    int uscita, nbin;
+    double x_min, x_max;
+    int dmc, walk_dmc, nblk_dmc, passi_dmc, term_dmc;
+    double tau_dmc;
 
-    ofstream fileout;
     ifstream ReadInput;
     ReadInput.open("input.in");
 
@@ -89,17 +139,51 @@ int main (int argc, char *argv[]){
     ReadInput >> Tfin;
     ReadInput >> delta1;
     ReadInput >> camp;
-
-
-    var_Mod2 campiona(mu, sigma, delta);
-    asp_H calcola(nblk, dimblk);
+    ReadInput >> integratore;
+    ReadInput >> nwalk;
+    ReadInput >> nterm;
+    ReadInput >> nthread;
+    ReadInput >> soglia;
+    ReadInput >> ottimizzatore;
+    ReadInput >> tau;
+    ReadInput >> eps;
+    ReadInput >> dmax;
+    ReadInput >> iter_sr;
+    ReadInput >> mu_min;
+    ReadInput >> mu_max;
+    ReadInput >> nmu;
+    ReadInput >> sigma_min;
+    ReadInput >> sigma_max;
+    ReadInput >> nsigma;
+    ReadInput >> vicini;
+    ReadInput >> accettazione;
+    ReadInput >> uscita;
+    ReadInput >> nbin;
+    ReadInput >> x_min;
+    ReadInput >> x_max;
+    ReadInput >> dmc;
+    ReadInput >> tau_dmc;
+    ReadInput >> walk_dmc;
+    ReadInput >> nblk_dmc;
+    ReadInput >> passi_dmc;
+    ReadInput >> term_dmc;
+
+
+    var_Mod2<Psi> campiona(Psi(mu, sigma), delta);
+    campiona.Set_accettazione(accettazione);
+    asp_H<Psi> singolo(nblk, dimblk, nterm);
+    ensemble_H<Psi> ensemble(nblk, dimblk, nwalk, nterm, nthread);
+    reweight_H<Psi> ripesato(nblk, dimblk, soglia, nterm);
+    asp_H<Psi>& calcola = (integratore == 1) ? (asp_H<Psi>&)ensemble : (integratore == 2) ? (asp_H<Psi>&)ripesato : singolo;   //Integratore scelto in input.in
     SimAnnealing ottimizzazione(Tin, Tfin, delta1);
+    StocRec ottimizzazione_sr(tau, eps, dmax, iter_sr);
 
     
     /**********************************************
-    *             Simulated Annealing             *
+    *   Simulated Annealing / Stoc. Reconf.       *
     **********************************************/
-    ottimizzazione.SA(calcola, campiona);
+    if(ottimizzatore == 1) ottimizzazione_sr.SR(calcola, campiona);
+    else ottimizzazione.SA(calcola, campiona);
     cout << endl << endl;
 
 
@@ -107,61 +191,52 @@ int main (int argc, char *argv[]){
     *         Integrale (parametri ott.)          *
     **********************************************/
     calcola.Integrale(campiona, 1);
+
+
+    /**********************************************
+    *      Diffusion Monte Carlo (psi ott.)       *
+    **********************************************/
+    if(dmc == 1) {
+        DMC<Psi> diffusione(tau_dmc, walk_dmc, nblk_dmc, passi_dmc, term_dmc, nthread);
+        diffusione.Esegui(campiona, 1);
+    }
     
 
     /**********************************************
     *       Campionamento (parametri ott.)        *
     **********************************************/
-    fileout.open("Campionamento.dat");
+    Scrittore* campioni;    //Testo, binario o istogramma a seconda di "uscita"
+    if(uscita == 1) { campioni = new Scrittore_binario("Campionamento.bin"); }
+    else if(uscita == 2) { campioni = new Istogramma("Istogramma.dat", nbin, x_min, x_max, max(1L, (camp + 1L)/nblk)); }
+    else { campioni = new Scrittore_testo("Campionamento.dat"); }
     //Controllo l'apertura del file
-    if(!fileout) {
-        cout << "Errore in apertura file di ouput: Campionamento.dat" << endl;
+    if(campioni->Errore()) {
+        cout << "Errore in apertura file di ouput dei campioni" << endl;
         cout << "Blocco l'esecuzione del programma: ciao!!" << endl;
         return 0;
     }
 
     x = 0; appo = 0;
-    fileout << x << endl;
+    campioni->Scrivi(x);
     for(int i=0; i<camp; i++){
         appo += campiona.Move(x);
-        fileout << x << endl;
+        campioni->Scrivi(x);
     }
 
     cout << endl << "Effettuato campionamento modulo quadro" << endl;
     cout << "Acceptance rate: " << (double)appo/camp * 100 << "%" << endl;
 
-    fileout.close();
+    campioni->Chiudi();
+    delete campioni;
     
 
     /**********************************************
     *        Calcoli integrali - grafico          *
     **********************************************/
     cout << endl << endl << "Eseguo calcolo per grafico energia in funzione di mu e sigma" << endl;
-    fileout.open("Grafico.dat");
-    //Controllo l'apertura del file
-    if(!fileout) {
-        cout << "Errore in apertura file di ouput: Grafico.dat" << endl;
-        cout << "Blocco l'esecuzione del programma: ciao!!" << endl;
-        return 0;
-    }
-
-    for(int i=0; i<=10; i++){
-        
-        mu = 0.5 + 0.1 * i;
-        
-        for(int j=0; j<=10; j++){
-            sigma = 0.5 + 0.1 * j;
-
-            campiona.Set_mu(mu);
-            campiona.Set_sigma(sigma);
-
-            calcola.Integrale(campiona, 0);
-            fileout << calcola.Get_integrale() << " ";
-        }
-        fileout << endl;
-    }
-
-    fileout.close();
+    Griglia<Psi> griglia(campiona.Get_psi(), mu_min, mu_max, nmu, sigma_min, sigma_max, nsigma, vicini, nthread);
+    griglia.Scansione(nblk, dimblk, delta, accettazione, soglia, nterm);
+    griglia.Stampa("Grafico.dat");
     
 
     return 0;
@@ -186,8 +261,8 @@ int main (int argc, char *argv[]){
 **********************************************/
 
 /*
-    campiona.Set_mu(-0.886557);
-    campiona.Set_sigma(0.482185);
+    campiona.Set_par(0, -0.886557);
+    campiona.Set_par(1, 0.482185);
 
     calcola.Set_nblk(100);
     calcola.Set_dimblk(10000);